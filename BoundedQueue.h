@@ -0,0 +1,112 @@
+/*
+	Copyright (c) 2013, Remi Thebault
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+		* Redistributions of source code must retain the above copyright
+		  notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above copyright
+		  notice, this list of conditions and the following disclaimer in the
+		  documentation and/or other materials provided with the distribution.
+		* Neither the name of the <organization> nor the
+		  names of its contributors may be used to endorse or promote products
+		  derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+	DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+
+// Queue between two stages of a pipeline. push blocks while the queue is
+// full, pop blocks while it is empty. Once closed, push fails and pop
+// returns the remaining items, then fails.
+template<typename T>
+class BoundedQueue {
+public:
+
+	explicit BoundedQueue(size_t capacity)
+		: capacity_(capacity > 0 ? capacity : 1)
+		, closed_(false)
+	{}
+
+	// false if the queue was closed
+	bool push(const T& item)
+	{
+		std::unique_lock<std::mutex> lock (mutex_);
+		notFull_.wait(lock, [this]() {
+			return closed_ || items_.size() < capacity_;
+		});
+		if (closed_) {
+			return false;
+		}
+		items_.push_back(item);
+		notEmpty_.notify_one();
+		return true;
+	}
+
+	// false if the queue is closed and empty
+	bool pop(T& item)
+	{
+		std::unique_lock<std::mutex> lock (mutex_);
+		notEmpty_.wait(lock, [this]() {
+			return closed_ || !items_.empty();
+		});
+		if (items_.empty()) {
+			return false;
+		}
+		item = items_.front();
+		items_.pop_front();
+		notFull_.notify_one();
+		return true;
+	}
+
+	// waits for one item and takes up to maxItems, false as pop
+	bool popBatch(std::vector<T>& items, size_t maxItems)
+	{
+		std::unique_lock<std::mutex> lock (mutex_);
+		notEmpty_.wait(lock, [this]() {
+			return closed_ || !items_.empty();
+		});
+		if (items_.empty()) {
+			return false;
+		}
+		while (!items_.empty() && items.size() < maxItems) {
+			items.push_back(items_.front());
+			items_.pop_front();
+		}
+		notFull_.notify_all();
+		return true;
+	}
+
+	void close()
+	{
+		std::lock_guard<std::mutex> lock (mutex_);
+		closed_ = true;
+		notFull_.notify_all();
+		notEmpty_.notify_all();
+	}
+
+private:
+
+	size_t capacity_;
+	bool closed_;
+	std::deque<T> items_;
+	std::mutex mutex_;
+	std::condition_variable notFull_;
+	std::condition_variable notEmpty_;
+};
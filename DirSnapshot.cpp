@@ -0,0 +1,187 @@
+/*
+	Copyright (c) 2013, Remi Thebault
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+		* Redistributions of source code must retain the above copyright
+		  notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above copyright
+		  notice, this list of conditions and the following disclaimer in the
+		  documentation and/or other materials provided with the distribution.
+		* Neither the name of the <organization> nor the
+		  names of its contributors may be used to endorse or promote products
+		  derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+	DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "DirSnapshot.h"
+#include "StringUtils.h"
+
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+
+
+using namespace std;
+
+
+
+namespace {
+
+	const char *snapshotHeader = "qtgentools-snapshot 2";
+
+}
+
+
+
+void DirSnapshot::load(const string& path)
+{
+	dirs_.clear();
+	changed_ = true;
+
+	ifstream in (path);
+	string line;
+	if (!getline(in, line) || line != snapshotHeader) {
+		return;
+	}
+
+	// D \t mtime \t inode \t path, followed by its F \t name, S \t name
+	// and L \t name for the files, sub directories and symbolic links
+	Dir *dir = NULL;
+	while (getline(in, line)) {
+		if (line.size() < 3 || line[1] != '\t') {
+			dirs_.clear();
+			return;
+		}
+		if (line[0] == 'D') {
+			vector<string> fields;
+			su::split(line, '\t', back_inserter(fields));
+			if (fields.size() != 4) {
+				dirs_.clear();
+				return;
+			}
+			dir = &dirs_[fields[3]];
+			dir->mtime = strtoull(fields[1].c_str(), NULL, 10);
+			dir->inode = strtoull(fields[2].c_str(), NULL, 10);
+		}
+		else if (dir && (line[0] == 'F' || line[0] == 'S' || line[0] == 'L')) {
+			Child child;
+			child.name = line.substr(2);
+			child.isDir = line[0] == 'S';
+			child.isLink = line[0] == 'L';
+			dir->children.push_back(child);
+		}
+		else {
+			dirs_.clear();
+			return;
+		}
+	}
+	changed_ = false;
+}
+
+
+
+bool DirSnapshot::save(const string& path)
+{
+	if (!changed_) {
+		return true;
+	}
+
+	ostringstream buf;
+	buf << snapshotHeader << '\n';
+	for (auto it = dirs_.begin(); it != dirs_.end(); ++it) {
+		buf << "D\t" << it->second.mtime << '\t' << it->second.inode << '\t' << it->first << '\n';
+		for (size_t i=0; i<it->second.children.size(); ++i) {
+			const Child& child = it->second.children[i];
+			if (child.name.find('\n') != string::npos) continue;
+			buf << (child.isLink ? "L\t" : child.isDir ? "S\t" : "F\t") << child.name << '\n';
+		}
+	}
+
+	ofstream out (path, ios::binary | ios::trunc);
+	out << buf.str();
+	if (!out) {
+		return false;
+	}
+	changed_ = false;
+	return true;
+}
+
+
+
+#ifndef _WIN32
+bool DirSnapshot::entries(const string& dir, vector<Child>*& children)
+{
+	struct stat st;
+	if (::stat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+		return false;
+	}
+	// reached again through a symbolic link
+	if (!walkedIds_.insert(make_pair((unsigned long long)st.st_dev,
+	                                 (unsigned long long)st.st_ino)).second) {
+		return false;
+	}
+
+	Dir& current = walked_[dir];
+	current.mtime = st.st_mtime;
+	current.inode = st.st_ino;
+	children = &current.children;
+
+	auto found = dirs_.find(dir);
+	if (found != dirs_.end() && found->second.mtime == current.mtime &&
+	        found->second.inode == current.inode) {
+		current.children.swap(found->second.children);
+		return true;
+	}
+
+	DIR *dp = opendir(dir.c_str());
+	if (dp == NULL) {
+		current.mtime = 0;
+		return false;
+	}
+	struct dirent *ep;
+	while ((ep = readdir(dp))) {
+		if (ep->d_name[0] == '.') continue;
+
+		Child child;
+		child.name = ep->d_name;
+		child.isDir = false;
+		child.isLink = false;
+#ifdef _DIRENT_HAVE_D_TYPE
+		if (ep->d_type == DT_DIR) child.isDir = true;
+		else if (ep->d_type == DT_LNK) child.isLink = true;
+		else if (ep->d_type != DT_REG) {
+			child.isLink = fu::isSymlink(dir + child.name);
+			child.isDir = !child.isLink && fu::isDir(dir + child.name);
+		}
+#else
+		child.isLink = fu::isSymlink(dir + child.name);
+		child.isDir = !child.isLink && fu::isDir(dir + child.name);
+#endif
+		// such a name cannot be stored
+		if (child.name.find('\n') != string::npos) {
+			current.mtime = 0;
+		}
+		current.children.push_back(child);
+	}
+	closedir(dp);
+	++dirsRead_;
+
+	// a change in the same second would not change the time stamp
+	if (time_t(current.mtime) >= start_ - 1) {
+		current.mtime = 0;
+	}
+	changed_ = true;
+	return true;
+}
+#endif
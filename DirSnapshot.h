@@ -0,0 +1,158 @@
+/*
+	Copyright (c) 2013, Remi Thebault
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+		* Redistributions of source code must retain the above copyright
+		  notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above copyright
+		  notice, this list of conditions and the following disclaimer in the
+		  documentation and/or other materials provided with the distribution.
+		* Neither the name of the <organization> nor the
+		  names of its contributors may be used to endorse or promote products
+		  derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+	DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "FileUtils.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <ctime>
+
+
+// Entries of the directories of a tree, as found by a previous walk.
+// A directory whose modification time and inode did not change since then
+// has the same entries, they are taken from the snapshot instead of
+// reading the directory again. Directories modified less than a second
+// before they are read are read again at the next walk, their time stamp
+// could hide a change. Symbolic links are resolved at each walk, their
+// target can change without changing the directory, and followed last as
+// fu::walk does.
+// Not available on Windows, where walk is fu::walk.
+class DirSnapshot {
+public:
+
+	DirSnapshot() : start_(0), dirsRead_(0), changed_(false) {}
+
+	// a missing or invalid snapshot file gives an empty snapshot
+	void load(const std::string& path);
+	// does nothing if the snapshot did not change since it was loaded
+	bool save(const std::string& path);
+
+	// same as fu::walk, without reporting directories
+	template<class ActionT>
+	void walk(std::string root, ActionT& action,
+	          fu::SymlinkPolicy symlinks = fu::FollowSymlinks);
+
+	// directories read during the last walk
+	size_t dirsRead() const {
+		return dirsRead_;
+	}
+
+private:
+
+	struct Child {
+		std::string name;
+		bool isDir;
+		bool isLink;	// isDir is not known
+	};
+
+	struct Dir {
+		unsigned long long mtime;
+		unsigned long long inode;
+		std::vector<Child> children;
+	};
+
+	// false if the directory cannot be read or was already walked
+	bool entries(const std::string& dir, std::vector<Child>*& children);
+
+	template<class ActionT>
+	void walkDir(const std::string& dir, ActionT& action, fu::SymlinkPolicy symlinks);
+
+	std::map<std::string, Dir> dirs_;
+	std::map<std::string, Dir> walked_;
+	fu::DirIds walkedIds_;
+	fu::DirLinks links_;
+	time_t start_;
+	size_t dirsRead_;
+	bool changed_;
+};
+
+
+
+template<class ActionT>
+void DirSnapshot::walk(std::string root, ActionT& action, fu::SymlinkPolicy symlinks)
+{
+#ifdef _WIN32
+	fu::walk(root, action, false, symlinks);
+#else
+	if (root.back() != fu::pathSep) root.push_back(fu::pathSep);
+
+	walked_.clear();
+	walkedIds_.clear();
+	start_ = time(NULL);
+	dirsRead_ = 0;
+
+	walkDir(root, action, symlinks);
+
+	// links_ grows while the linked directories are walked
+	for (size_t i=0; i<links_.size(); ++i) {
+		std::string dir = links_[i].first;
+		std::string name = links_[i].second;
+		if (fu::isDir(dir + name)) {
+			walkDir(dir + name + fu::pathSep, action, symlinks);
+		}
+		else {
+			action(dir, name, false);
+		}
+	}
+	links_.clear();
+
+	// directories that are gone are forgotten
+	if (walked_.size() != dirs_.size()) {
+		changed_ = true;
+	}
+	dirs_.swap(walked_);
+	walked_.clear();
+#endif
+}
+
+
+
+template<class ActionT>
+void DirSnapshot::walkDir(const std::string& dir, ActionT& action, fu::SymlinkPolicy symlinks)
+{
+	std::vector<Child> *children;
+	if (!entries(dir, children)) {
+		return;
+	}
+
+	for (size_t i=0; i<children->size(); ++i) {
+		const Child& child = (*children)[i];
+		if (child.isLink) {
+			if (symlinks == fu::FollowSymlinks) {
+				links_.push_back(std::make_pair(dir, child.name));
+			}
+		}
+		else if (child.isDir) {
+			walkDir(dir + child.name + fu::pathSep, action, symlinks);
+		}
+		else {
+			action(dir, child.name, false);
+		}
+	}
+}
@@ -0,0 +1,1218 @@
+/*
+	Copyright (c) 2013, Remi Thebault
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+		* Redistributions of source code must retain the above copyright
+		  notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above copyright
+		  notice, this list of conditions and the following disclaimer in the
+		  documentation and/or other materials provided with the distribution.
+		* Neither the name of the <organization> nor the
+		  names of its contributors may be used to endorse or promote products
+		  derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+	DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "Driver.h"
+#include "StringUtils.h"
+#include "FileUtils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+
+using namespace std;
+
+
+
+namespace {
+
+	const char *indexFilename = ".qtgentools_index";
+	const char *snapshotFilename = ".qtgentools_snapshot";
+	const char *prefixFilename = ".qtgentools_prefix";
+	const char *sharedFilename = ".qtgentools_shared";
+
+}
+
+
+
+string guessQtBinPath()
+{
+	string qtBinPath;
+	char *qt = getenv("QT5");
+	if (qt) {
+		qtBinPath = string(qt);
+		if (qtBinPath.back() != fu::pathSep) qtBinPath.push_back(fu::pathSep);
+		qtBinPath.append("bin");
+		qtBinPath.push_back(fu::pathSep);
+	}
+	else {
+		string path = string(getenv("PATH"));
+		vector<string> pathComps;
+		su::split(path, fu::pathVarSep, back_inserter(pathComps));
+		for (size_t i=0; i<pathComps.size(); ++i) {
+			string p = pathComps[i];
+			if (p.back() != fu::pathSep) p.push_back(fu::pathSep);
+#ifdef _WIN32
+			string qmake = p + string("qmake.exe");
+#else
+			string qmake = p + string("qmake");
+#endif
+			ifstream test (qmake, ios::binary);
+			if (test) {
+				test.close();
+				qtBinPath = p;
+				break;
+			}
+		}
+	}
+	return qtBinPath;
+}
+
+
+
+DriverResult Driver::run(const DriverConfig& config)
+{
+	auto start = chrono::steady_clock::now();
+
+	// a single toolchain unless several are configured
+	vector<ToolchainConfig> toolchains = config.toolchains;
+	if (toolchains.empty()) {
+		ToolchainConfig toolchain;
+		toolchain.qtBinPath = config.qtBinPath;
+		toolchain.outD = config.outD;
+		toolchains.push_back(toolchain);
+	}
+
+	for (size_t i=0; i<toolchains.size(); ++i) {
+		ToolchainConfig& toolchain = toolchains[i];
+		if (toolchain.qtBinPath.size() == 0 && config.toolchains.empty()) {
+			toolchain.qtBinPath = guessQtBinPath();
+		}
+		if (toolchain.qtBinPath.size() == 0 || !fu::isDir(toolchain.qtBinPath)) {
+			throw runtime_error("qt bin directory is not valid" +
+			                    (toolchain.name.size() > 0 ? ": " + toolchain.name : string()));
+		}
+		if (toolchain.outD.size() == 0) {
+			throw runtime_error("output directory was not specified" +
+			                    (toolchain.name.size() > 0 ? ": " + toolchain.name : string()));
+		}
+		if (toolchain.qtBinPath.back() != fu::pathSep) toolchain.qtBinPath.push_back(fu::pathSep);
+		if (toolchain.outD.back() != fu::pathSep) toolchain.outD.push_back(fu::pathSep);
+		for (size_t j=0; j<i; ++j) {
+			if (toolchains[j].name == toolchain.name) {
+				throw runtime_error("duplicate toolchain: " + toolchain.name);
+			}
+			if (toolchains[j].outD == toolchain.outD) {
+				throw runtime_error("toolchains share an output directory: " + toolchain.outD);
+			}
+		}
+	}
+	if (config.inD.size() == 0 || !fu::isDir(config.inD)) {
+		throw runtime_error("input directory is not valid");
+	}
+	if (config.pathBase.size() > 0 && !fu::isDir(config.pathBase)) {
+		throw runtime_error("path base directory is not valid");
+	}
+	if (config.pathBase.size() > 0 && fu::isRoot(config.pathBase)) {
+		throw runtime_error("path base directory cannot be a root directory");
+	}
+	if (config.prefixHeader.find_first_of("/\\ \"") != string::npos) {
+		throw runtime_error("prefix header is not a file name: " + config.prefixHeader);
+	}
+	// Q_INIT_RESOURCE(name) makes a function name of it
+	if (config.rccShared.find_first_not_of("abcdefghijklmnopqrstuvwxyz"
+	                                       "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_") != string::npos) {
+		throw runtime_error("shared resources name is not an identifier: " + config.rccShared);
+	}
+	if (config.shardCount > 1 &&
+	        (config.shardIndex < 1 || config.shardIndex > config.shardCount)) {
+		throw runtime_error("shard index is out of range");
+	}
+
+	inD_ = config.inD;
+	outD_ = toolchains[0].outD;
+	if (inD_.back() != fu::pathSep) inD_.push_back(fu::pathSep);
+	shardIndex_ = config.shardIndex;
+	shardCount_ = config.shardCount;
+	index_ = config.index;
+	only_ = config.only.size() > 0;
+	prefixHeader_ = config.prefixHeader;
+	rccShared_ = config.rccShared;
+	pathBase_.clear();
+	if (config.pathBase.size() > 0) {
+		// the tools run from there, the Qt bin paths must not be relative
+		pathBase_ = fu::absolutePath(config.pathBase);
+		if (pathBase_.back() != fu::pathSep) pathBase_.push_back(fu::pathSep);
+		for (size_t i=0; i<toolchains.size(); ++i) {
+			toolchains[i].qtBinPath = fu::absolutePath(toolchains[i].qtBinPath);
+			toolchains[i].qtBinPath.push_back(fu::pathSep);
+		}
+	}
+
+	files_.clear();
+	files_.setIoUring(config.ioUring);
+
+	ownedTools_.clear();
+	toolchains_.clear();
+	sources_.clear();
+	result_ = DriverResult();
+	result_.inD = inD_;
+
+	for (size_t i=0; i<toolchains.size(); ++i) {
+		createTools(config, toolchains[i]);
+
+		Toolchain toolchain;
+		toolchain.name = toolchains[i].name;
+		toolchain.outD = toolchains[i].outD;
+		toolchain.tools = tools_;
+
+		if (!fu::isDir(toolchain.outD)) {
+			if (!fu::mkDir(toolchain.outD)) {
+				throw runtime_error("could not create the output directory: " + toolchain.outD);
+			}
+		}
+		// the other outputs are unknown when only some inputs are checked
+		if (!only_) {
+			fu::listDir(toolchain.outD, back_inserter(toolchain.oldFiles));
+			for (size_t j=0; j<toolchain.oldFiles.size(); ++j) {
+				toolchain.oldFiles[j] = toolchain.outD + toolchain.oldFiles[j];
+			}
+		}
+
+		if (i > 0) result_.outD.push_back(',');
+		result_.outD += toolchain.outD;
+		toolchains_.push_back(toolchain);
+
+		PrefixHeader& prefix = toolchains_.back().prefix;
+		prefix.load(toolchain.outD + prefixFilename);
+		if (prefixHeader_.size() > 0 && prefix.name() != prefixHeader_) {
+			// the outputs include another header, or none
+			prefix.reset(prefixHeader_);
+		}
+	}
+
+	// the inputs are classified with the tools of the first toolchain
+	tools_ = toolchains_[0].tools;
+	extensions_.build(tools_);
+
+	unsigned jobs = config.jobs;
+	if (jobs == 0) {
+		jobs = max(1u, thread::hardware_concurrency());
+	}
+
+	// inputs are checked by chunks so that prefetched contents stay small
+	const size_t chunk = 512;
+	BoundedQueue<Entry> entries (8 * chunk);
+	BoundedQueue<Job *> pending (2 * jobs);
+	entries_ = &entries;
+	pending_ = (jobs > 1) ? &pending : NULL;
+	jobs_.clear();
+	rccJobs_.clear();
+	inputIds_.clear();
+
+	// the qrc files of the previous run are needed with only some inputs
+	string sharedPath = outD_ + sharedFilename;
+	if (rccShared_.size() > 0) {
+		sharedResources_.load(sharedPath);
+	}
+	else {
+		fu::rm(sharedPath);
+	}
+
+	vector<string> walkErrors;
+	thread walker ([&]() {
+		walk(config, walkErrors);
+		entries.close();
+	});
+	vector<thread> workers;
+	for (unsigned i=0; pending_ && i<jobs; ++i) {
+		workers.push_back(thread([&]() {
+			Job *job;
+			while (pending.pop(job)) {
+				runJob(*job);
+			}
+		}));
+	}
+
+	try {
+		vector<Entry> batch;
+		while (entries.popBatch(batch, chunk)) {
+			check(batch);
+			batch.clear();
+		}
+		if (rccShared_.size() > 0) {
+			shareResources();
+		}
+	}
+	catch (...) {
+		entries.close();
+		pending.close();
+		walker.join();
+		for (size_t i=0; i<workers.size(); ++i) workers[i].join();
+		entries_ = NULL;
+		pending_ = NULL;
+		throw;
+	}
+	pending.close();
+	walker.join();
+	for (size_t i=0; i<workers.size(); ++i) workers[i].join();
+	entries_ = NULL;
+	pending_ = NULL;
+
+	result_.errors.insert(result_.errors.end(), walkErrors.begin(), walkErrors.end());
+	for (size_t i=0; i<jobs_.size(); ++i) {
+		collect(jobs_[i]);
+	}
+	jobs_.clear();
+
+	if (index_) {
+		updateIndex();
+	}
+
+	for (size_t t=0; t<toolchains_.size(); ++t) {
+		Toolchain& toolchain = toolchains_[t];
+		set<string> newFiles (toolchain.newFiles.begin(), toolchain.newFiles.end());
+		updatePrefixHeader(toolchain, newFiles);
+
+		for (size_t i=0; i<toolchain.oldFiles.size(); ++i) {
+			const string& oldFile = toolchain.oldFiles[i];
+			if (newFiles.find(oldFile) != newFiles.end()) {
+				continue;
+			}
+			FileRecord record;
+			record.toolchain = toolchain.name;
+			record.output = oldFile;
+			if (fu::rm(oldFile)) {
+				fu::rm(QtMocTool::depFilename(oldFile));
+				fu::rm(QtRccTool::fingerprintFilename(oldFile));
+				fu::rm(QtRccTool::sharedQrcFilename(oldFile));
+				result_.deleted.push_back(oldFile);
+				record.action = "deleted";
+				record.reason = "no input";
+			}
+			else {
+				cerr << "could not delete " << oldFile << "\n";
+				result_.errors.push_back(oldFile + ": could not delete");
+				record.action = "error";
+				record.reason = "could not delete";
+			}
+			result_.records.push_back(record);
+		}
+	}
+
+	result_.durationMs = chrono::duration<double, milli>(
+	                         chrono::steady_clock::now() - start).count();
+	return result_;
+}
+
+
+
+void Driver::createTools(const DriverConfig& config, const ToolchainConfig& toolchain)
+{
+	tools_.clear();
+
+	// toolchain options first, then the common ones
+	auto opts = [&](const string& name, const string& common) {
+		auto found = toolchain.toolOpts.find(name);
+		return (found != toolchain.toolOpts.end()) ? found->second : common;
+	};
+
+	addTool(registry_.create("moc"))->setCmdOpts(opts("moc", config.mocOpts));
+	addTool(registry_.create("uic"))->setCmdOpts(opts("uic", config.uicOpts));
+
+	QtRccTool *rcc = dynamic_cast<QtRccTool *>(addTool(registry_.create("rcc")));
+	if (rcc) {
+		rcc->setCmdOpts(opts("rcc", config.rccOpts));
+		rcc->setMode(config.rccMode);
+		for (auto it = config.rccModes.begin(); it != config.rccModes.end(); ++it) {
+			rcc->setMode(it->first, it->second);
+		}
+		rcc->setAutoThreshold(config.rccThreshold);
+		rcc->setFingerprint(config.rccFingerprint);
+		rcc->setSharedResources(config.rccShared.size() > 0);
+	}
+
+	for (size_t i=0; i<config.tools.size(); ++i) {
+		const ToolConfig& tc = config.tools[i];
+		QtTool *tool = findTool(tc.name);
+		if (!tool) {
+			if (registry_.has(tc.name)) {
+				tool = addTool(registry_.create(tc.name));
+			}
+			else if (tc.exe.size() > 0 && tc.extensions.size() > 0 && tc.outPattern.size() > 0) {
+				tool = addTool(unique_ptr<QtTool>(new QtGenericTool(
+				                   tc.name, tc.exe, tc.extensions, tc.outPattern, tc.args)));
+			}
+			else {
+				throw runtime_error("unknown tool: " + tc.name);
+			}
+		}
+		string toolOpts = opts(tc.name, tc.opts);
+		if (toolOpts.size() > 0) tool->setCmdOpts(toolOpts);
+		if (tc.extensions.size() > 0) tool->setExtensions(tc.extensions);
+		if (tc.outPattern.size() > 0) tool->setOutPattern(tc.outPattern);
+	}
+
+	for (size_t i=0; i<tools_.size(); ++i) {
+		tools_[i]->init(toolchain.qtBinPath);
+		tools_[i]->setFileCache(&files_);
+		tools_[i]->setWorkDir(pathBase_);
+		tools_[i]->setPrefixHeader(prefixHeader_);
+	}
+}
+
+
+
+QtTool *Driver::findTool(const string& name)
+{
+	for (size_t i=0; i<tools_.size(); ++i) {
+		if (name == tools_[i]->name()) {
+			return tools_[i];
+		}
+	}
+	return NULL;
+}
+
+
+
+QtTool *Driver::addTool(unique_ptr<QtTool> tool)
+{
+	if (!tool) {
+		throw runtime_error("tool is not registered");
+	}
+	ownedTools_.push_back(move(tool));
+	tools_.push_back(ownedTools_.back().get());
+	return tools_.back();
+}
+
+
+
+DriverResult Driver::merge(const vector<string>& shardDirs, const string& outD)
+{
+	auto start = chrono::steady_clock::now();
+
+	outD_ = outD;
+	if (outD_.size() == 0) {
+		throw runtime_error("output directory was not specified");
+	}
+	if (outD_.back() != fu::pathSep) outD_.push_back(fu::pathSep);
+
+	result_ = DriverResult();
+	result_.outD = outD_;
+	for (size_t i=0; i<shardDirs.size(); ++i) {
+		if (!fu::isDir(shardDirs[i])) {
+			throw runtime_error("shard directory is not valid: " + shardDirs[i]);
+		}
+		if (i > 0) result_.inD.push_back(',');
+		result_.inD += shardDirs[i];
+	}
+
+	if (!fu::isDir(outD_)) {
+		if (!fu::mkDir(outD_)) {
+			throw runtime_error("could not create the output directory");
+		}
+	}
+
+	// each shard has the prefix header of its own outputs, the merged one
+	// includes the headers of all of them
+	vector<PrefixHeader> shardPrefixes;
+	for (size_t i=0; i<shardDirs.size(); ++i) {
+		string dir = shardDirs[i];
+		if (dir.back() != fu::pathSep) dir.push_back(fu::pathSep);
+
+		PrefixHeader shardPrefix;
+		shardPrefix.load(dir + prefixFilename);
+		if (shardPrefix.name().empty()) {
+			continue;
+		}
+		if (shardPrefixes.size() > 0 && shardPrefix.name() != shardPrefixes[0].name()) {
+			result_.errors.push_back(dir + prefixFilename + ": prefix header " + shardPrefix.name() +
+			                         " differs from " + shardPrefixes[0].name());
+			continue;
+		}
+		shardPrefixes.push_back(shardPrefix);
+	}
+	string prefixName = shardPrefixes.empty() ? string() : shardPrefixes[0].name();
+
+	// filename -> shard file
+	map<string, string> merged;
+
+	for (size_t i=0; i<shardDirs.size(); ++i) {
+		string dir = shardDirs[i];
+		if (dir.back() != fu::pathSep) dir.push_back(fu::pathSep);
+
+		vector<string> files;
+		fu::listDir(dir, back_inserter(files));
+		for (size_t j=0; j<files.size(); ++j) {
+			if (files[j] == prefixName) {
+				continue;
+			}
+			string shardFile = dir + files[j];
+			string outFile = outD_ + files[j];
+
+			FileRecord record;
+			record.input = shardFile;
+			record.output = outFile;
+
+			string shardData;
+			string outData;
+			FileCache::readSync(shardFile, shardData);
+
+			auto found = merged.find(files[j]);
+			if (found != merged.end()) {
+				FileCache::readSync(found->second, outData);
+				if (outData != shardData) {
+					result_.errors.push_back(shardFile + ": differs from " + found->second);
+					record.action = "error";
+					record.reason = "produced by several shards";
+					result_.records.push_back(record);
+				}
+				continue;
+			}
+			merged[files[j]] = shardFile;
+
+			bool existed = FileCache::readSync(outFile, outData);
+			if (existed && outData == shardData) {
+				result_.untouched.push_back(outFile);
+				record.action = "untouched";
+				record.reason = "up to date";
+			}
+			else if (fu::copyFile(shardFile, outFile)) {
+				record.action = existed ? "updated" : "generated";
+				record.reason = existed ? "out of date" : "missing output";
+				(existed ? result_.updated : result_.generated).push_back(outFile);
+			}
+			else {
+				result_.errors.push_back(outFile + ": could not copy " + shardFile);
+				record.action = "error";
+				record.reason = "could not copy";
+			}
+			result_.records.push_back(record);
+		}
+	}
+
+	// the hidden state of an output comes from the shard that generated it
+	for (auto it = merged.begin(); it != merged.end(); ++it) {
+		string outFile = outD_ + it->first;
+		mergeState(QtMocTool::depFilename(it->second), QtMocTool::depFilename(outFile));
+		mergeState(QtRccTool::fingerprintFilename(it->second), QtRccTool::fingerprintFilename(outFile));
+		mergeState(QtRccTool::sharedQrcFilename(it->second), QtRccTool::sharedQrcFilename(outFile));
+	}
+
+	PrefixHeader prefix;
+	prefix.load(outD_ + prefixFilename);
+	if (prefixName.size() > 0 && prefix.name() != prefixName) {
+		prefix.reset(prefixName);
+	}
+	prefix.merge(shardPrefixes);
+	if (prefixName.size() > 0) {
+		FileRecord record;
+		record.output = outD_ + prefixName;
+		writePrefixHeader(prefix, record);
+	}
+	if (!prefix.save(outD_ + prefixFilename)) {
+		result_.errors.push_back(outD_ + prefixFilename + ": could not write");
+	}
+
+	// the index and the snapshot describe the whole input directory, and
+	// only the shard of the qrc files keeps the shared resources
+	const char *stateFilenames[] = { indexFilename, snapshotFilename, sharedFilename };
+	for (size_t i=0; i<sizeof(stateFilenames) / sizeof(stateFilenames[0]); ++i) {
+		string shardFile;
+		for (size_t j=0; j<shardDirs.size() && shardFile.empty(); ++j) {
+			string dir = shardDirs[j];
+			if (dir.back() != fu::pathSep) dir.push_back(fu::pathSep);
+			if (fu::isFile(dir + stateFilenames[i])) {
+				shardFile = dir + stateFilenames[i];
+			}
+		}
+		mergeState(shardFile, outD_ + stateFilenames[i]);
+	}
+
+	vector<string> oldFiles;
+	fu::listDir(outD_, back_inserter(oldFiles));
+	for (size_t i=0; i<oldFiles.size(); ++i) {
+		if (merged.find(oldFiles[i]) != merged.end() || oldFiles[i] == prefixName) {
+			continue;
+		}
+		FileRecord record;
+		record.output = outD_ + oldFiles[i];
+		if (fu::rm(record.output)) {
+			fu::rm(QtMocTool::depFilename(record.output));
+			fu::rm(QtRccTool::fingerprintFilename(record.output));
+			fu::rm(QtRccTool::sharedQrcFilename(record.output));
+			result_.deleted.push_back(record.output);
+			record.action = "deleted";
+			record.reason = "no input";
+		}
+		else {
+			result_.errors.push_back(record.output + ": could not delete");
+			record.action = "error";
+			record.reason = "could not delete";
+		}
+		result_.records.push_back(record);
+	}
+
+	result_.durationMs = chrono::duration<double, milli>(
+	                         chrono::steady_clock::now() - start).count();
+	return result_;
+}
+
+
+
+void Driver::mergeState(const string& shardFile, const string& outFile)
+{
+	string shardData;
+	string outData;
+	if (shardFile.empty() || !FileCache::readSync(shardFile, shardData)) {
+		// a state file without a shard counterpart would be out of date
+		fu::rm(outFile);
+		return;
+	}
+	if (FileCache::readSync(outFile, outData) && outData == shardData) {
+		return;
+	}
+	if (!fu::copyFile(shardFile, outFile)) {
+		result_.errors.push_back(outFile + ": could not copy " + shardFile);
+	}
+}
+
+
+
+unsigned Driver::shardOf(const string& relPath, unsigned shardCount)
+{
+	if (shardCount <= 1) {
+		return 1;
+	}
+	// same shard whatever the platform path separator
+	string path = relPath;
+	replace(path.begin(), path.end(), '\\', '/');
+	return unsigned(su::hash(path) % shardCount) + 1;
+}
+
+
+
+void Driver::operator()(const string& root, const string& filename, bool)
+{
+	// a shard output can be included by sources of any shard
+	if (index_ && IncludeIndex::isSource(filename)) {
+		sources_.push_back(root + filename);
+	}
+
+	// the qrc files sharing resources are generated together
+	QtTool *tool = (rccShared_.size() > 0) ? extensions_.find(filename) : NULL;
+	bool together = tool && string(tool->name()) == "rcc";
+
+	if (shardCount_ > 1 && !(together && shardIndex_ == 1)) {
+		// listed inputs are not always given from inD
+		string relPath = su::beginsWith(root, inD_) ?
+		                 root.substr(inD_.size()) + filename :
+		                 fu::relativePath(root + filename, inD_);
+		if (together || shardOf(relPath, shardCount_) != shardIndex_) {
+			return;
+		}
+	}
+
+	Entry entry;
+	entry.root = root;
+	entry.filename = filename;
+	entries_->push(entry);
+}
+
+
+
+void Driver::walk(const DriverConfig& config, vector<string>& errors)
+{
+	if (only_) {
+		set<string> listed;
+		for (size_t i=0; i<config.only.size(); ++i) {
+			const string& path = config.only[i];
+			if (!listed.insert(path).second) {
+				continue;
+			}
+			if (!fu::isFile(path)) {
+				errors.push_back(path + ": no such file");
+				continue;
+			}
+			string root = fu::parentDir(path);
+			(*this)(root, path.substr(root.size()), false);
+		}
+
+		// the qrc files sharing resources depend on each other
+		const vector<string>& qrcFiles = sharedResources_.qrcFiles();
+		for (size_t i=0; rccShared_.size() > 0 && i<qrcFiles.size(); ++i) {
+			const string& path = qrcFiles[i];
+			if (listed.find(path) == listed.end() && fu::isFile(path)) {
+				string root = fu::parentDir(path);
+				(*this)(root, path.substr(root.size()), false);
+			}
+		}
+		return;
+	}
+
+	bool walked = false;
+	if (config.gitIndex) {
+		walked = gitIndex_.load(inD_);
+		if (walked) {
+			gitIndex_.walk(inD_, *this, config.symlinks);
+		}
+		else {
+			cerr << "no usable git index for " << inD_ << ", walking it\n";
+		}
+	}
+
+	if (!walked && config.snapshot) {
+		string snapshotFile = outD_ + snapshotFilename;
+		snapshot_.load(snapshotFile);
+		snapshot_.walk(inD_, *this, config.symlinks);
+		if (!snapshot_.save(snapshotFile)) {
+			errors.push_back(snapshotFile + ": could not write");
+		}
+	}
+	else if (!walked) {
+		fu::walk(inD_, *this, false, config.symlinks);
+	}
+}
+
+
+
+void Driver::check(const vector<Entry>& entries)
+{
+	// each file goes to at most one tool, found from its extension
+	vector<QtTool *> candidates (entries.size());
+
+	// the inputs that tools will read are fetched in one batch
+	vector<string> reads;
+	for (size_t i=0; i<entries.size(); ++i) {
+		candidates[i] = extensions_.find(entries[i].filename);
+		if (candidates[i] && candidates[i]->readsInput()) {
+			reads.push_back(entries[i].root + entries[i].filename);
+		}
+	}
+	files_.prefetch(vector<string>(), reads);
+
+	vector<Job> inputs;
+	vector<string> stats;
+
+	for (size_t i=0; i<entries.size(); ++i) {
+		QtTool *tool = candidates[i];
+		if (!tool) {
+			continue;
+		}
+
+		string inFile = entries[i].root + entries[i].filename;
+		if(!tool->isFileInput(inFile)) {
+			continue;
+		}
+		stats.push_back(inFile);
+
+		vector<string> outFilenames;
+		tool->getOutFilenames(inFile, entries[i].filename, outFilenames);
+		size_t toolIndex = find(tools_.begin(), tools_.end(), tool) - tools_.begin();
+
+		// same input and output names for every toolchain
+		for (size_t t=0; t<toolchains_.size(); ++t) {
+			Job input;
+			input.toolchain = t;
+			input.tool = toolchains_[t].tools[toolIndex];
+			input.inFile = inFile;
+			input.filename = entries[i].filename;
+			for (size_t k=0; k<outFilenames.size(); ++k) {
+				input.outFiles.push_back(toolchains_[t].outD + outFilenames[k]);
+				stats.push_back(input.outFiles.back());
+			}
+			inputs.push_back(input);
+		}
+	}
+	files_.prefetch(stats, vector<string>());
+
+	for (size_t i=0; i<inputs.size(); ++i) {
+		// listed inputs can be gone (deleted but still in the git index)
+		FileCache::Info info = files_.stat(inputs[i].inFile);
+		if (!info.isFile) {
+			continue;
+		}
+		// listed twice, or reached again through a symbolic link
+		auto id = (info.ino != 0) ?
+		          make_tuple(inputs[i].toolchain, info.dev, info.ino, inputs[i].filename) :
+		          make_tuple(inputs[i].toolchain, 0ULL, 0ULL, inputs[i].inFile);
+		if (!inputIds_.insert(id).second) {
+			continue;
+		}
+
+		jobs_.push_back(move(inputs[i]));
+		Job& job = jobs_.back();
+		for (size_t j=0; j<job.outFiles.size(); ++j) {
+			job.existed.push_back(files_.stat(job.outFiles[j]).isFile);
+		}
+
+		// rcc needs the resources shared with the qrc files not found yet
+		if (rccShared_.size() > 0 && dynamic_cast<QtRccTool *>(job.tool)) {
+			rccJobs_.push_back(&job);
+			continue;
+		}
+		schedule(job);
+	}
+
+	files_.clearContents();
+}
+
+
+
+void Driver::schedule(Job& job)
+{
+	auto start = chrono::steady_clock::now();
+	if (!job.ran) {
+		job.ran = job.tool->needsToRun(job.inFile, job.outFiles[0], job.stale);
+	}
+
+	// generated with another prefix header, or without
+	if (!job.ran) {
+		const Toolchain& toolchain = toolchains_[job.toolchain];
+		bool included = job.tool->includesPrefixHeader(job.inFile);
+		if (included != toolchain.prefix.has(job.outFiles[0].substr(toolchain.outD.size()))) {
+			job.ran = true;
+			job.stale.rule = included ? "missing prefix header" : "prefix header removed";
+			job.stale.file = job.outFiles[0];
+		}
+	}
+	job.durationMs += chrono::duration<double, milli>(
+	                      chrono::steady_clock::now() - start).count();
+
+	if (job.ran) {
+		if (pending_) {
+			pending_->push(&job);
+		}
+		else {
+			runJob(job);
+		}
+	}
+}
+
+
+
+void Driver::shareResources()
+{
+	// found from the qrc files of the first toolchain, the binary mode ones
+	// are loaded at run time and the big resources ones are embedded by the
+	// second pass of rcc: they share nothing
+	vector<string> qrcFiles;
+	for (size_t i=0; i<rccJobs_.size(); ++i) {
+		const Job& job = *rccJobs_[i];
+		QtRccTool *rcc = static_cast<QtRccTool *>(job.tool);
+		if (job.toolchain == 0 && rcc->modeOf(job.inFile) == QtRccTool::Embed) {
+			qrcFiles.push_back(job.inFile);
+		}
+	}
+	sharedResources_.update(qrcFiles, &files_);
+	string statePath = outD_ + sharedFilename;
+	// the other shards have no qrc file, their state would hide the one to merge
+	if (shardCount_ > 1 && shardIndex_ != 1) {
+		fu::rm(statePath);
+	}
+	else if (!sharedResources_.save(statePath)) {
+		result_.errors.push_back(statePath + ": could not write");
+	}
+
+	// only the qrc files whose resources changed are given to rcc again
+	for (size_t i=0; i<rccJobs_.size(); ++i) {
+		Job& job = *rccJobs_[i];
+		string sharedQrc = QtRccTool::sharedQrcFilename(job.outFiles[0]);
+		bool existed = files_.stat(sharedQrc).isFile;
+
+		if (sharedResources_.shares(job.inFile)) {
+			string contents = sharedResources_.qrcContents(job.inFile, toolchains_[job.toolchain].outD);
+			string current;
+			if (!existed || !FileCache::readSync(sharedQrc, current) || current != contents) {
+				ofstream out (sharedQrc, ios::binary | ios::trunc);
+				out << contents;
+				files_.invalidate(sharedQrc);
+				if (!out) {
+					job.error = "cannot write " + sharedQrc;
+					continue;
+				}
+				job.ran = true;
+				job.stale.rule = job.existed[0] ? "shared resources changed" : "missing output";
+				job.stale.file = job.existed[0] ? sharedQrc : job.outFiles[0];
+			}
+		}
+		else if (existed) {
+			fu::rm(sharedQrc);
+			files_.invalidate(sharedQrc);
+			job.ran = true;
+			job.stale.rule = "resources no longer shared";
+			job.stale.file = sharedQrc;
+		}
+		schedule(job);
+	}
+
+	for (size_t t=0; t<toolchains_.size(); ++t) {
+		writeSharedUnit(toolchains_[t]);
+	}
+}
+
+
+
+void Driver::writeSharedUnit(Toolchain& toolchain)
+{
+	QtRccTool *rcc = NULL;
+	for (size_t i=0; i<toolchain.tools.size(); ++i) {
+		if (string(toolchain.tools[i]->name()) == "rcc") {
+			rcc = static_cast<QtRccTool *>(toolchain.tools[i]);
+		}
+	}
+	// with nothing shared, a previous unit is deleted as an output without input
+	unsigned long long signature = rcc ? sharedResources_.signature(rccShared_, rcc->cmdOpts(), prefixHeader_) : 0;
+	if (signature == 0) {
+		return;
+	}
+
+	FileRecord record;
+	record.toolchain = toolchain.name;
+	record.tool = "rcc";
+	record.output = toolchain.outD + rcc->getOutFilename(rccShared_ + ".qrc");
+	toolchain.newFiles.push_back(record.output);
+
+	// the unit is up to date if generated from the same qrc file
+	string qrcFile = QtRccTool::sharedQrcFilename(record.output);
+	bool existed = fu::isFile(record.output);
+	if (existed && SharedResources::unitSignature(qrcFile) == signature) {
+		result_.untouched.push_back(record.output);
+		record.action = "untouched";
+		record.reason = "up to date";
+		result_.records.push_back(record);
+		return;
+	}
+
+	int exitStatus = 0;
+	string error;
+	ofstream out (qrcFile, ios::binary | ios::trunc);
+	out << sharedResources_.unitQrcContents(toolchain.outD, signature);
+	out.close();
+	files_.invalidate(qrcFile);
+	if (!out) {
+		error = "cannot write " + qrcFile;
+	}
+	else {
+		try {
+			exitStatus = rcc->runUnit(qrcFile, record.output, rccShared_);
+		}
+		catch (const runtime_error& err) {
+			error = err.what();
+		}
+	}
+	if (error.empty() && exitStatus == 0 && pathBase_.size() > 0) {
+		normalizeOutput(record.output);
+	}
+
+	record.exitStatus = exitStatus;
+	if (error.empty() && exitStatus != 0) {
+		ostringstream status;
+		status << "rcc exited with status " << exitStatus;
+		error = status.str();
+	}
+
+	if (error.size() > 0) {
+		// the unit is generated again at the next run
+		fu::rm(qrcFile);
+		result_.errors.push_back(record.output + ": " + error);
+		record.action = "error";
+		record.reason = error;
+	}
+	else if (existed) {
+		result_.updated.push_back(record.output);
+		record.action = "updated";
+		record.reason = "out of date";
+	}
+	else {
+		result_.generated.push_back(record.output);
+		record.action = "generated";
+		record.reason = "missing output";
+	}
+	result_.records.push_back(record);
+}
+
+
+
+void Driver::runJob(Job& job)
+{
+	auto start = chrono::steady_clock::now();
+	try {
+		job.exitStatus = job.tool->run(job.inFile, job.outFiles[0]);
+	}
+	catch (const runtime_error& err) {
+		job.error = err.what();
+	}
+	if (pathBase_.size() > 0 && job.error.empty() && job.exitStatus == 0) {
+		for (size_t i=0; i<job.outFiles.size(); ++i) {
+			if (job.tool->isTextOutput(job.outFiles[i])) {
+				normalizeOutput(job.outFiles[i]);
+			}
+		}
+	}
+	if (job.error.empty() && job.exitStatus == 0 && job.tool->includesPrefixHeader(job.inFile)) {
+		string contents;
+		FileCache::readSync(job.outFiles[0], contents);
+		job.prefixed = true;
+		job.headers = PrefixHeader::parseIncludes(contents);
+	}
+	job.durationMs += chrono::duration<double, milli>(
+	                      chrono::steady_clock::now() - start).count();
+}
+
+
+
+void Driver::normalizeOutput(const string& path)
+{
+	string contents;
+	if (!FileCache::readSync(path, contents)) {
+		return;
+	}
+
+	string normalized = normalizePaths(contents, pathBase_);
+#ifdef _WIN32
+	string slashes = pathBase_;
+	replace(slashes.begin(), slashes.end(), '\\', '/');
+	normalized = normalizePaths(normalized, slashes);
+#endif
+
+	if (normalized != contents) {
+		ofstream out (path, ios::binary | ios::trunc);
+		out << normalized;
+	}
+}
+
+
+
+string Driver::normalizePaths(const string& contents, const string& base)
+{
+	if (base.empty() || (base.back() != '/' && base.back() != '\\')) {
+		return contents;
+	}
+
+	// The paths the tools write: the include of the input by moc, the
+	// input named by the header comment of moc and uic, and the source
+	// file comment of each resource written by rcc. Other text, like
+	// #include <QtCore/qobject.h>, is kept whatever the base.
+	static const char *const tokens[][2] = {
+		{ "#include \"", "\"" },
+		{ "file '", "'" },
+		{ "// ", "\n" },
+	};
+
+	string normalized;
+	normalized.reserve(contents.size());
+	size_t start = 0;
+	while (start < contents.size()) {
+		size_t end = contents.find('\n', start);
+		end = (end == string::npos) ? contents.size() : end + 1;
+		string line = contents.substr(start, end - start);
+		for (size_t i=0; i<sizeof(tokens) / sizeof(tokens[0]); ++i) {
+			size_t pos = line.find(tokens[i][0]);
+			if (pos == string::npos) {
+				continue;
+			}
+			pos += strlen(tokens[i][0]);
+			// the comments run to the end of the line
+			if (line.compare(pos, base.size(), base) == 0 && (tokens[i][1][0] == '\n' ||
+			        line.find(tokens[i][1], pos + base.size()) != string::npos)) {
+				line.erase(pos, base.size());
+			}
+		}
+		normalized += line;
+		start = end;
+	}
+	return normalized;
+}
+
+
+
+void Driver::collect(const Job& job)
+{
+	const vector<string>& outFiles = job.outFiles;
+
+	FileRecord record;
+	record.toolchain = toolchains_[job.toolchain].name;
+	record.tool = job.tool->name();
+	record.input = job.inFile;
+	record.durationMs = job.durationMs;
+	record.exitStatus = job.exitStatus;
+	record.stale = job.stale;
+
+	if (job.error.size() > 0) {
+		result_.errors.push_back(job.filename + ": " + job.error);
+		record.output = outFiles[0];
+		record.action = "error";
+		record.reason = job.error;
+		result_.records.push_back(record);
+		return;
+	}
+
+	if (job.exitStatus != 0) {
+		ostringstream out;
+		out << job.filename << ": " << record.tool << " exited with status " << job.exitStatus;
+		result_.errors.push_back(out.str());
+	}
+	else if (job.ran) {
+		Toolchain& toolchain = toolchains_[job.toolchain];
+		string outName = outFiles[0].substr(toolchain.outD.size());
+		if (job.prefixed) {
+			toolchain.prefix.add(outName, job.headers);
+		}
+		else {
+			toolchain.prefix.remove(outName);
+		}
+	}
+
+	for (size_t j=0; j<outFiles.size(); ++j) {
+		record.output = outFiles[j];
+		if (!job.ran) {
+			result_.untouched.push_back(outFiles[j]);
+			record.action = "untouched";
+			record.reason = "up to date";
+		}
+		else {
+			files_.invalidate(outFiles[j]);
+			record.reason = job.existed[j] ? "out of date" : "missing output";
+			if (job.exitStatus != 0) {
+				record.action = "error";
+			}
+			else if (job.existed[j]) {
+				result_.updated.push_back(outFiles[j]);
+				record.action = "updated";
+			}
+			else {
+				result_.generated.push_back(outFiles[j]);
+				record.action = "generated";
+			}
+		}
+		result_.records.push_back(record);
+		toolchains_[job.toolchain].newFiles.push_back(outFiles[j]);
+	}
+}
+
+
+
+void Driver::updateIndex()
+{
+	string indexFile = outD_ + indexFilename;
+	includeIndex_.load(indexFile);
+	includeIndex_.update(sources_, files_, !only_);
+	if (!includeIndex_.save(indexFile)) {
+		result_.errors.push_back(indexFile + ": could not write");
+	}
+
+	for (size_t i=0; i<result_.records.size(); ++i) {
+		FileRecord& record = result_.records[i];
+		if (record.action != "generated" && record.action != "updated") {
+			continue;
+		}
+		string filename = record.output.substr(fu::parentDir(record.output).size());
+		if (isGenerated(filename)) {
+			record.affected = includeIndex_.consumers(filename);
+		}
+	}
+}
+
+
+
+void Driver::updatePrefixHeader(Toolchain& toolchain, set<string>& newFiles)
+{
+	// forget the outputs about to be deleted, unknown with only some inputs
+	if (!only_) {
+		set<string> outputs;
+		for (auto it = newFiles.begin(); it != newFiles.end(); ++it) {
+			outputs.insert(it->substr(toolchain.outD.size()));
+		}
+		toolchain.prefix.retain(outputs);
+	}
+
+	if (prefixHeader_.size() > 0) {
+		FileRecord record;
+		record.toolchain = toolchain.name;
+		record.output = toolchain.outD + prefixHeader_;
+		newFiles.insert(record.output);
+		writePrefixHeader(toolchain.prefix, record);
+	}
+
+	string statePath = toolchain.outD + prefixFilename;
+	if (!toolchain.prefix.save(statePath)) {
+		result_.errors.push_back(statePath + ": could not write");
+	}
+}
+
+
+
+void Driver::writePrefixHeader(const PrefixHeader& prefix, FileRecord& record)
+{
+	bool existed = fu::isFile(record.output);
+	bool written;
+	if (!prefix.write(record.output, written)) {
+		result_.errors.push_back(record.output + ": could not write");
+		record.action = "error";
+		record.reason = "could not write";
+	}
+	else if (!written) {
+		result_.untouched.push_back(record.output);
+		record.action = "untouched";
+		record.reason = "up to date";
+	}
+	else if (existed) {
+		result_.updated.push_back(record.output);
+		record.action = "updated";
+		record.reason = "out of date";
+	}
+	else {
+		result_.generated.push_back(record.output);
+		record.action = "generated";
+		record.reason = "missing output";
+	}
+	result_.records.push_back(record);
+}
+
+
+
+bool Driver::isGenerated(const string& filename) const
+{
+	// moc output of a source file, included by the source itself
+	if (su::endsWith(filename, string(".moc"))) {
+		return true;
+	}
+
+	for (size_t i=0; i<tools_.size(); ++i) {
+		const string& pattern = tools_[i]->outPattern();
+		size_t pos = pattern.find("@BASE@");
+		if (pos == string::npos) {
+			if (filename == pattern) return true;
+			continue;
+		}
+		string prefix = pattern.substr(0, pos);
+		string suffix = pattern.substr(pos + 6);
+		if (filename.size() > prefix.size() + suffix.size() &&
+		        su::beginsWith(filename, prefix) && su::endsWith(filename, suffix)) {
+			return true;
+		}
+	}
+	return false;
+}
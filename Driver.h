@@ -0,0 +1,336 @@
+/*
+	Copyright (c) 2013, Remi Thebault
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+		* Redistributions of source code must retain the above copyright
+		  notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above copyright
+		  notice, this list of conditions and the following disclaimer in the
+		  documentation and/or other materials provided with the distribution.
+		* Neither the name of the <organization> nor the
+		  names of its contributors may be used to endorse or promote products
+		  derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+	DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "QtTool.h"
+#include "FileCache.h"
+#include "ToolRegistry.h"
+#include "ExtensionTable.h"
+#include "IncludeIndex.h"
+#include "DirSnapshot.h"
+#include "GitIndex.h"
+#include "PrefixHeader.h"
+#include "SharedResources.h"
+#include "BoundedQueue.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <deque>
+#include <tuple>
+
+
+// A tool to run besides moc, uic and rcc, or overrides for one of them.
+// Tools that are not in the registry need exe and args.
+struct ToolConfig {
+	std::string name;
+	std::string opts;
+	std::vector<std::string> extensions;	// registered default if empty
+	std::string outPattern;					// registered default if empty, see QtTool
+	std::string exe;
+	std::string args;						// see QtGenericTool
+};
+
+
+
+// A Qt installation to generate with, and where its outputs go.
+struct ToolchainConfig {
+	std::string name;
+	std::string qtBinPath;
+	std::string outD;
+	// options per tool name (moc, uic, rcc...), replacing the DriverConfig ones
+	std::map<std::string, std::string> toolOpts;
+};
+
+
+
+// Everything needed for one generation run.
+// Options strings are given as is to the tools command line.
+struct DriverConfig {
+
+	DriverConfig()
+		: rccMode(QtRccTool::Embed)
+		, rccThreshold(8*1024*1024)
+		, rccFingerprint(false)
+		, ioUring(false)
+		, index(false)
+		, snapshot(false)
+		, gitIndex(false)
+		, symlinks(fu::FollowSymlinks)
+		, shardIndex(0)
+		, shardCount(0)
+		, jobs(0)
+	{}
+
+	std::string qtBinPath;		// guessed from QT5 or PATH if empty
+	std::string inD;
+	std::string outD;
+
+	std::string mocOpts;
+	std::string uicOpts;
+	std::string rccOpts;
+
+	QtRccTool::Mode rccMode;
+	std::map<std::string, QtRccTool::Mode> rccModes;	// per qrc filename
+	unsigned long long rccThreshold;
+	// run rcc when the contents of a qrc file or of its resources changed,
+	// instead of their modification times (see ResourceFingerprint)
+	bool rccFingerprint;
+	// If set, the name of a resource unit (rc_<name>.cc) registering once
+	// the contents embedded by several qrc files, which are then given to
+	// rcc without them (see SharedResources). The embedded or big mode qrc
+	// files all go to the first shard.
+	std::string rccShared;
+
+	// batch the stat and read calls through io_uring when available (Linux)
+	bool ioUring;
+
+	// Keep an index of the sources including generated files, to report
+	// which sources are affected by each generated or updated output.
+	// The index is stored in outD and only modified sources are read again.
+	bool index;
+
+	// Keep the entries of the input directories in outD, and list again only
+	// the directories modified since the previous run (not on Windows).
+	bool snapshot;
+
+	// Take the input files from the index of the git repository containing
+	// inD instead of walking it (see GitIndex). Walks inD if there is no
+	// usable index.
+	bool gitIndex;
+
+	// Whether the walk follows the symbolic links of inD. Followed or not,
+	// a directory is walked once, and an input reached through several
+	// paths is generated once.
+	fu::SymlinkPolicy symlinks;
+
+	// Generate only the inputs of shard shardIndex (1 based) out of
+	// shardCount. Inputs are split by a hash of their path relative to inD.
+	// Each shard must have its own output directory (see Driver::merge).
+	unsigned shardIndex;
+	unsigned shardCount;
+
+	// tool runs at the same time, the number of hardware threads if 0
+	unsigned jobs;
+
+	// If set, tools run from this directory with paths relative to it, and
+	// the occurrences of its absolute path are removed from the outputs, so
+	// that checkouts in different directories generate the same bytes.
+	std::string pathBase;
+
+	// If set, the file name of a header written in outD that the moc and
+	// rcc outputs include first, and that includes the system and Qt
+	// headers these outputs include (see PrefixHeader). It is written only
+	// when its contents change, so that a build can precompile it.
+	std::string prefixHeader;
+
+	// run in order after moc, uic and rcc
+	std::vector<ToolConfig> tools;
+
+	// Generate with several Qt installations in one walk: the inputs are
+	// found and classified once, and each toolchain runs its own tools into
+	// its own output directory. qtBinPath and outD are then not used.
+	std::vector<ToolchainConfig> toolchains;
+
+	// Check only these input files instead of walking inD, e.g. the files
+	// an IDE just saved. The output directories are not listed, so no
+	// stale output is deleted.
+	std::vector<std::string> only;
+};
+
+
+
+// What happened to one output file during a run.
+struct FileRecord {
+	FileRecord() : durationMs(0), exitStatus(0) {}
+
+	std::string toolchain;	// empty unless DriverConfig::toolchains is used
+	std::string tool;
+	std::string input;
+	std::string output;
+	std::string action;		// generated, updated, untouched, deleted or error
+	std::string reason;
+	double durationMs;		// staleness check and tool run
+	int exitStatus;
+	std::vector<std::string> affected;	// sources including the output (see DriverConfig::index)
+	StaleReason stale;		// why the tool ran, if it ran
+};
+
+
+
+// Outcome of a generation run. Files are output paths.
+// outD is a comma separated list with several toolchains.
+struct DriverResult {
+	DriverResult() : durationMs(0) {}
+
+	std::string inD;
+	std::string outD;
+	double durationMs;
+
+	std::vector<FileRecord> records;
+
+	std::vector<std::string> generated;
+	std::vector<std::string> updated;
+	std::vector<std::string> untouched;
+	std::vector<std::string> deleted;
+	std::vector<std::string> errors;
+};
+
+
+
+// Runs moc, uic, rcc and the configured tools over a directory tree.
+// A Driver holds no global state, several of them can run concurrently
+// as long as their output directories are different.
+// A run is a pipeline: a thread walks the input directory while the
+// calling thread checks the inputs it finds, and the tools run in worker
+// threads as soon as their outputs are found out of date.
+class Driver {
+public:
+
+	Driver() : entries_(NULL), pending_(NULL) {}
+
+	// throws std::runtime_error if the configuration is not usable
+	DriverResult run(const DriverConfig& config);
+
+	// Copies the files of the shards output directories that differ into
+	// outD, and deletes the files of outD that no shard has. The hidden
+	// state files (depfiles, fingerprints, index...) are copied too, so that
+	// a later run in outD stays incremental.
+	DriverResult merge(const std::vector<std::string>& shardDirs, const std::string& outD);
+
+	// Removes base, which ends with a path separator, from the paths the
+	// tools write in their text outputs.
+	static std::string normalizePaths(const std::string& contents, const std::string& base);
+
+	// the shard (1 based) of an input path relative to the input directory
+	static unsigned shardOf(const std::string& relPath, unsigned shardCount);
+
+	void operator()(const std::string& root, const std::string& filename, bool isdir);
+
+	// tools available to DriverConfig::tools
+	ToolRegistry& registry() {
+		return registry_;
+	}
+
+private:
+
+	// a Qt installation and its outputs
+	struct Toolchain {
+		std::string name;
+		std::string outD;
+		std::vector<QtTool *> tools;	// in the order of tools_
+		std::vector<std::string> oldFiles;
+		std::vector<std::string> newFiles;
+		PrefixHeader prefix;
+	};
+
+	// creates tools_ for a toolchain
+	void createTools(const DriverConfig& config, const ToolchainConfig& toolchain);
+	QtTool *findTool(const std::string& name);
+	QtTool *addTool(std::unique_ptr<QtTool> tool);
+
+	struct Entry {
+		std::string root;
+		std::string filename;
+	};
+
+	// one tool run on one input
+	struct Job {
+		Job() : toolchain(0), tool(NULL), ran(false), exitStatus(0), durationMs(0), prefixed(false) {}
+
+		size_t toolchain;
+		QtTool *tool;
+		std::string inFile;
+		std::string filename;
+		std::vector<std::string> outFiles;
+		std::vector<bool> existed;
+		bool ran;
+		int exitStatus;
+		StaleReason stale;
+		double durationMs;
+		std::string error;
+		bool prefixed;		// the output includes the prefix header
+		std::vector<std::string> headers;	// and these ones
+	};
+
+	// pipeline stages
+	void walk(const DriverConfig& config, std::vector<std::string>& errors);
+	void check(const std::vector<Entry>& entries);
+	void runJob(Job& job);
+	void schedule(Job& job);
+	void shareResources();
+	void writeSharedUnit(Toolchain& toolchain);
+	void collect(const Job& job);
+	void normalizeOutput(const std::string& path);
+	void updateIndex();
+	void updatePrefixHeader(Toolchain& toolchain, std::set<std::string>& newFiles);
+	void writePrefixHeader(const PrefixHeader& prefix, FileRecord& record);
+	bool isGenerated(const std::string& filename) const;
+	// copies a hidden state file of a shard, or deletes outFile without one
+	void mergeState(const std::string& shardFile, const std::string& outFile);
+
+	std::string inD_;
+	std::string outD_;		// of the first toolchain
+	unsigned shardIndex_;
+	unsigned shardCount_;
+	bool index_;
+	bool only_;
+	std::string pathBase_;
+	std::string prefixHeader_;
+	std::string rccShared_;
+
+	ToolRegistry registry_;
+	std::vector<std::unique_ptr<QtTool> > ownedTools_;
+
+	FileCache files_;
+
+	std::vector<QtTool *> tools_;			// of the first toolchain
+	std::vector<Toolchain> toolchains_;
+	ExtensionTable extensions_;
+	BoundedQueue<Entry> *entries_;
+	BoundedQueue<Job *> *pending_;
+	std::deque<Job> jobs_;		// in input order, references stay valid
+	std::vector<Job *> rccJobs_;	// checked once the shared resources are known
+	// (toolchain, device, inode, file name) of the inputs, the output names
+	// only depend on the file name; the path replaces the file name when
+	// the file has no inode
+	std::set<std::tuple<size_t, unsigned long long, unsigned long long, std::string> > inputIds_;
+	std::vector<std::string> sources_;
+	IncludeIndex includeIndex_;
+	SharedResources sharedResources_;
+	DirSnapshot snapshot_;
+	GitIndex gitIndex_;
+	DriverResult result_;
+};
+
+
+
+// returns the Qt bin directory found with the QT5 or PATH environment
+// variables, or an empty string
+std::string guessQtBinPath();
@@ -0,0 +1,104 @@
+/*
+	Copyright (c) 2013, Remi Thebault
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+		* Redistributions of source code must retain the above copyright
+		  notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above copyright
+		  notice, this list of conditions and the following disclaimer in the
+		  documentation and/or other materials provided with the distribution.
+		* Neither the name of the <organization> nor the
+		  names of its contributors may be used to endorse or promote products
+		  derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+	DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "ExtensionTable.h"
+#include "StringUtils.h"
+
+#include <algorithm>
+
+
+using namespace std;
+
+
+
+unsigned long long ExtensionTable::packKey(const char *ext, size_t size)
+{
+	if (size > 8) {
+		return 0;
+	}
+	unsigned long long key = 0;
+	for (size_t i=0; i<size; ++i) {
+		key = (key << 8) | static_cast<unsigned char>(ext[i]);
+	}
+	return key;
+}
+
+
+
+void ExtensionTable::build(const vector<QtTool *>& tools)
+{
+	entries_.clear();
+	multiDot_ = false;
+
+	for (size_t i=0; i<tools.size(); ++i) {
+		const vector<string>& exts = tools[i]->extensions();
+		for (size_t j=0; j<exts.size(); ++j) {
+			Entry entry;
+			entry.ext = exts[j];
+			size_t dot = entry.ext.rfind('.');
+			entry.keyStr = (dot == string::npos) ? entry.ext : entry.ext.substr(dot);
+			entry.key = packKey(entry.keyStr.data(), entry.keyStr.size());
+			entry.tool = tools[i];
+			if (entry.keyStr.size() != entry.ext.size()) {
+				multiDot_ = true;
+			}
+			entries_.push_back(entry);
+		}
+	}
+
+	// stable: tools order is kept among entries with the same key
+	stable_sort(entries_.begin(), entries_.end());
+}
+
+
+
+QtTool *ExtensionTable::find(const string& filename) const
+{
+	size_t dot = filename.rfind('.');
+	if (dot == string::npos) {
+		return NULL;
+	}
+
+	const char *ext = filename.data() + dot;
+	size_t size = filename.size() - dot;
+	unsigned long long key = packKey(ext, size);
+
+	// few entries: a linear scan on integers beats hashing the string
+	for (size_t i=0; i<entries_.size(); ++i) {
+		const Entry& entry = entries_[i];
+		if (entry.key != key) {
+			continue;
+		}
+		if (key == 0 && entry.keyStr.compare(0, string::npos, ext, size) != 0) {
+			continue;
+		}
+		if (!multiDot_ || entry.ext.size() == entry.keyStr.size() ||
+		        su::endsWith(filename, entry.ext)) {
+			return entry.tool;
+		}
+	}
+	return NULL;
+}
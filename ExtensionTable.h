@@ -0,0 +1,70 @@
+/*
+	Copyright (c) 2013, Remi Thebault
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+		* Redistributions of source code must retain the above copyright
+		  notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above copyright
+		  notice, this list of conditions and the following disclaimer in the
+		  documentation and/or other materials provided with the distribution.
+		* Neither the name of the <organization> nor the
+		  names of its contributors may be used to endorse or promote products
+		  derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+	DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "QtTool.h"
+
+#include <string>
+#include <vector>
+#include <utility>
+
+
+// Routes a file to the only tool that can take it, from its extension.
+// The table is built once from the tools extensions, then each lookup
+// extracts the file extension once and compares it as an integer, instead
+// of asking every tool to check every one of its extensions.
+class ExtensionTable {
+public:
+
+	ExtensionTable() : multiDot_(false) {}
+
+	// the first tool declaring an extension gets it
+	void build(const std::vector<QtTool *>& tools);
+
+	// returns NULL if no tool takes the file extension
+	QtTool *find(const std::string& filename) const;
+
+private:
+
+	// the last extension component (e.g. ".h") packed in an integer,
+	// 0 if it is longer than 8 characters
+	static unsigned long long packKey(const char *ext, size_t size);
+
+	struct Entry {
+		unsigned long long key;
+		std::string keyStr;	// last extension component, e.g. ".h"
+		std::string ext;	// full tool extension, e.g. ".h" or ".ui.xml"
+		QtTool *tool;
+
+		bool operator<(const Entry& other) const {
+			return key < other.key || (key == other.key && keyStr < other.keyStr);
+		}
+	};
+
+	std::vector<Entry> entries_;
+	bool multiDot_;		// some extensions need a full suffix check
+};
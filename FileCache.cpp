@@ -0,0 +1,562 @@
+/*
+	Copyright (c) 2013, Remi Thebault
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+		* Redistributions of source code must retain the above copyright
+		  notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above copyright
+		  notice, this list of conditions and the following disclaimer in the
+		  documentation and/or other materials provided with the distribution.
+		* Neither the name of the <organization> nor the
+		  names of its contributors may be used to endorse or promote products
+		  derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+	DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "FileCache.h"
+#include "FileUtils.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef QTGENTOOLS_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/sysmacros.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <ctime>
+
+
+using namespace std;
+
+
+
+#ifdef QTGENTOOLS_IO_URING
+
+namespace {
+
+	// Minimal io_uring wrapper over the raw system calls.
+	// Usage is strictly batch by batch: queue at most capacity() entries,
+	// then submitAndWait() and pop all the completions.
+	class IoRing {
+	public:
+
+		IoRing() : fd_(-1), sqPtr_(MAP_FAILED), cqPtr_(MAP_FAILED), sqes_(MAP_FAILED),
+			sqSize_(0), cqSize_(0), sqesSize_(0), queued_(0), inFlight_(0) {}
+
+		~IoRing() {
+			if (sqes_ != MAP_FAILED) munmap(sqes_, sqesSize_);
+			if (cqPtr_ != MAP_FAILED && cqPtr_ != sqPtr_) munmap(cqPtr_, cqSize_);
+			if (sqPtr_ != MAP_FAILED) munmap(sqPtr_, sqSize_);
+			if (fd_ >= 0) close(fd_);
+		}
+
+		bool init(unsigned entries) {
+			io_uring_params p;
+			memset(&p, 0, sizeof(p));
+			fd_ = int(syscall(__NR_io_uring_setup, entries, &p));
+			if (fd_ < 0) return false;
+
+			sqSize_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+			cqSize_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+			bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+			if (single) {
+				sqSize_ = cqSize_ = max(sqSize_, cqSize_);
+			}
+
+			sqPtr_ = mmap(0, sqSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			              fd_, IORING_OFF_SQ_RING);
+			if (sqPtr_ == MAP_FAILED) return false;
+			if (single) {
+				cqPtr_ = sqPtr_;
+			}
+			else {
+				cqPtr_ = mmap(0, cqSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				              fd_, IORING_OFF_CQ_RING);
+				if (cqPtr_ == MAP_FAILED) return false;
+			}
+			sqesSize_ = p.sq_entries * sizeof(io_uring_sqe);
+			sqes_ = mmap(0, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			             fd_, IORING_OFF_SQES);
+			if (sqes_ == MAP_FAILED) return false;
+
+			char *sq = static_cast<char *>(sqPtr_);
+			char *cq = static_cast<char *>(cqPtr_);
+			sqHead_ = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+			sqTail_ = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+			sqMask_ = *reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+			sqArray_ = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+			cqHead_ = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+			cqTail_ = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+			cqMask_ = *reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+			cqes_ = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+			capacity_ = p.sq_entries;
+			return true;
+		}
+
+		unsigned capacity() const {
+			return capacity_;
+		}
+
+		io_uring_sqe& push(unsigned char opcode, int fd, const void *addr,
+		                   unsigned len, unsigned long long off, unsigned long long userData) {
+			unsigned tail = *sqTail_ + queued_;
+			unsigned idx = tail & sqMask_;
+			io_uring_sqe& sqe = static_cast<io_uring_sqe *>(sqes_)[idx];
+			memset(&sqe, 0, sizeof(sqe));
+			sqe.opcode = opcode;
+			sqe.fd = fd;
+			sqe.addr = reinterpret_cast<unsigned long long>(addr);
+			sqe.len = len;
+			sqe.off = off;
+			sqe.user_data = userData;
+			sqArray_[idx] = idx;
+			++queued_;
+			return sqe;
+		}
+
+		// Submits the queued entries and waits for all of them to complete.
+		// On failure, the entries the kernel did not take are dropped, and
+		// the ones it took are waited for; inFlight() is not 0 if the wait
+		// failed too.
+		bool submitAndWait() {
+			__atomic_store_n(sqTail_, *sqTail_ + queued_, __ATOMIC_RELEASE);
+			unsigned toSubmit = queued_;
+			inFlight_ += queued_;
+			queued_ = 0;
+			while (toSubmit > 0 || pending() < inFlight_) {
+				unsigned wait = inFlight_ - pending();
+				int ret = int(syscall(__NR_io_uring_enter, fd_, toSubmit, wait,
+				                      IORING_ENTER_GETEVENTS, NULL, 0));
+				if (ret < 0) {
+					if (errno == EINTR) continue;
+					// without SQPOLL, only io_uring_enter takes entries
+					unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+					inFlight_ -= *sqTail_ - head;
+					__atomic_store_n(sqTail_, head, __ATOMIC_RELEASE);
+					drain();
+					return false;
+				}
+				toSubmit -= min(toSubmit, unsigned(ret));
+			}
+			return true;
+		}
+
+		// entries submitted and not popped yet
+		unsigned inFlight() const {
+			return inFlight_;
+		}
+
+		bool pop(unsigned long long& userData, int& res) {
+			unsigned head = *cqHead_;
+			if (head == __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) {
+				return false;
+			}
+			const io_uring_cqe& cqe = cqes_[head & cqMask_];
+			userData = cqe.user_data;
+			res = cqe.res;
+			__atomic_store_n(cqHead_, head+1, __ATOMIC_RELEASE);
+			--inFlight_;
+			return true;
+		}
+
+	private:
+
+		unsigned pending() const {
+			return __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE) - *cqHead_;
+		}
+
+		void drain() {
+			while (pending() < inFlight_) {
+				int ret = int(syscall(__NR_io_uring_enter, fd_, 0, inFlight_ - pending(),
+				                      IORING_ENTER_GETEVENTS, NULL, 0));
+				if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+					return;
+				}
+			}
+		}
+
+		int fd_;
+		void *sqPtr_;
+		void *cqPtr_;
+		void *sqes_;
+		size_t sqSize_;
+		size_t cqSize_;
+		size_t sqesSize_;
+		unsigned *sqHead_;
+		unsigned *sqTail_;
+		unsigned sqMask_;
+		unsigned *sqArray_;
+		unsigned *cqHead_;
+		unsigned *cqTail_;
+		unsigned cqMask_;
+		io_uring_cqe *cqes_;
+		unsigned capacity_;
+		unsigned queued_;
+		unsigned inFlight_;
+	};
+
+
+	const unsigned ringEntries = 256;
+
+	void closeAll(const vector<int>& fds)
+	{
+		for (size_t i=0; i<fds.size(); ++i) {
+			if (fds[i] >= 0) close(fds[i]);
+		}
+	}
+
+	// what the kernel writes to for a batch of files, and what was found
+	struct Batch {
+		explicit Batch(size_t n) : stx(n), statRes(n, -EINVAL), fds(n, -1), infos(n),
+			bufs(n), read(n, false) {}
+
+		vector<struct statx> stx;
+		vector<int> statRes;
+		vector<int> fds;		// -1 once closed
+		vector<FileCache::Info> infos;
+		vector<string> bufs;
+		vector<bool> read;		// bufs holds the contents
+	};
+
+	FileCache::Info toInfo(const struct statx& stx)
+	{
+		FileCache::Info info;
+		info.exists = true;
+		info.isFile = S_ISREG(stx.stx_mode);
+		info.isDir = S_ISDIR(stx.stx_mode);
+		info.mtime = stx.stx_mtime.tv_sec;
+		info.size = stx.stx_size;
+		// same device numbers as stat
+		info.dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+		info.ino = stx.stx_ino;
+		return info;
+	}
+
+	// Stats, and opens, reads and closes if reads[i], paths[start] to
+	// paths[start + n]. The batch must outlive the ring if entries are left
+	// in flight after a failure.
+	bool fetchBatch(IoRing& ring, const vector<string>& paths, const vector<bool>& reads,
+	                size_t start, Batch& batch)
+	{
+		size_t n = batch.fds.size();
+
+		// first round: each path takes two entries (statx and openat)
+		for (size_t i=0; i<n; ++i) {
+			const string& path = paths[start+i];
+			ring.push(IORING_OP_STATX, AT_FDCWD, path.c_str(), STATX_BASIC_STATS,
+			          reinterpret_cast<unsigned long long>(&batch.stx[i]), i*2);
+			if (reads[start+i]) {
+				io_uring_sqe& sqe = ring.push(IORING_OP_OPENAT, AT_FDCWD, path.c_str(),
+				                              0, 0, i*2+1);
+				sqe.open_flags = O_RDONLY | O_CLOEXEC;
+			}
+		}
+		bool ok = ring.submitAndWait();
+
+		unsigned long long userData;
+		int res;
+		while (ring.pop(userData, res)) {
+			if (userData % 2 == 0) batch.statRes[userData/2] = res;
+			else batch.fds[userData/2] = res;
+		}
+
+		// second round: read the files whose size is known
+		size_t queued = 0;
+		for (size_t i=0; i<n; ++i) {
+			if (batch.statRes[i] == 0) {
+				batch.infos[i] = toInfo(batch.stx[i]);
+			}
+			else if (batch.statRes[i] == -ENOENT || batch.statRes[i] == -ENOTDIR) {
+				batch.infos[i] = FileCache::Info();
+			}
+			else {
+				batch.infos[i] = FileCache::statSync(paths[start+i]);
+			}
+			if (ok && batch.fds[i] >= 0 && batch.statRes[i] == 0 && S_ISREG(batch.stx[i].stx_mode)) {
+				batch.bufs[i].resize(size_t(batch.stx[i].stx_size));
+				if (batch.bufs[i].size() > 0) {
+					ring.push(IORING_OP_READ, batch.fds[i], &batch.bufs[i][0],
+					          unsigned(batch.bufs[i].size()), 0, i);
+					++queued;
+				}
+				else {
+					batch.read[i] = true;
+				}
+			}
+		}
+		if (queued > 0) {
+			ok = ring.submitAndWait();
+			while (ring.pop(userData, res)) {
+				// short reads are left to the synchronous path
+				size_t i = size_t(userData);
+				batch.read[i] = (res == int(batch.bufs[i].size()));
+			}
+		}
+
+		// third round: close, a failed close releases the descriptor too
+		queued = 0;
+		for (size_t i=0; ok && i<n; ++i) {
+			if (batch.fds[i] >= 0) {
+				ring.push(IORING_OP_CLOSE, batch.fds[i], NULL, 0, 0, i);
+				++queued;
+			}
+		}
+		if (queued > 0) {
+			ok = ring.submitAndWait();
+			while (ring.pop(userData, res)) {
+				batch.fds[size_t(userData)] = -1;
+			}
+		}
+
+		// the descriptors the ring did not close, unless the kernel may
+		// still use them (they could be reused once closed)
+		if (ring.inFlight() == 0) {
+			closeAll(batch.fds);
+		}
+		return ok;
+	}
+
+}
+
+// the ring of a cache, kept between the prefetch batches
+class FileCache::Ring : public IoRing {};
+
+#else
+
+class FileCache::Ring {};
+
+#endif // QTGENTOOLS_IO_URING
+
+
+
+FileCache::FileCache()
+	: ioUring_(false)
+{
+}
+
+
+
+FileCache::~FileCache()
+{
+}
+
+
+
+bool FileCache::ioUringSupported()
+{
+#ifdef QTGENTOOLS_IO_URING
+	IoRing ring;
+	return ring.init(1);
+#else
+	return false;
+#endif
+}
+
+
+
+void FileCache::setIoUring(bool enabled)
+{
+	lock_guard<mutex> ringLock (ringMutex_);
+	lock_guard<mutex> lock (mutex_);
+	ioUring_ = false;
+#ifdef QTGENTOOLS_IO_URING
+	if (enabled && !ring_) {
+		unique_ptr<Ring> ring (new Ring);
+		if (ring->init(ringEntries)) {
+			ring_ = move(ring);
+		}
+	}
+	ioUring_ = enabled && ring_;
+#else
+	(void)enabled;
+#endif
+}
+
+
+
+FileCache::Info FileCache::statSync(const string& path)
+{
+	Info info;
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (GetFileAttributesEx(path.c_str(), GetFileExInfoStandard, &data)) {
+		info.exists = true;
+		info.isDir = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+		info.isFile = !info.isDir;
+		info.mtime = (static_cast<unsigned long long>(data.ftLastWriteTime.dwHighDateTime) << 32) |
+		             data.ftLastWriteTime.dwLowDateTime;
+		info.size = (static_cast<unsigned long long>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+		fu::fileId(path, info.dev, info.ino);
+	}
+#else
+	struct stat st;
+	if (0 == ::stat(path.c_str(), &st)) {
+		info.exists = true;
+		info.isFile = S_ISREG(st.st_mode);
+		info.isDir = S_ISDIR(st.st_mode);
+		info.mtime = st.st_mtime;
+		info.size = st.st_size;
+		info.dev = st.st_dev;
+		info.ino = st.st_ino;
+	}
+#endif
+	return info;
+}
+
+
+
+unsigned long long FileCache::now()
+{
+#ifdef _WIN32
+	FILETIME ft;
+	GetSystemTimeAsFileTime(&ft);
+	return (static_cast<unsigned long long>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+#else
+	return static_cast<unsigned long long>(time(NULL));
+#endif
+}
+
+
+
+bool FileCache::readSync(const string& path, string& contents)
+{
+	ifstream in (path, ios::binary);
+	if (!in) return false;
+	ostringstream oss;
+	oss << in.rdbuf();
+	contents = oss.str();
+	return true;
+}
+
+
+
+FileCache::Info FileCache::stat(const string& path)
+{
+	{
+		lock_guard<mutex> lock (mutex_);
+		auto found = infos_.find(path);
+		if (found != infos_.end()) {
+			return found->second;
+		}
+	}
+	Info info = statSync(path);
+	lock_guard<mutex> lock (mutex_);
+	infos_[path] = info;
+	return info;
+}
+
+
+
+bool FileCache::read(const string& path, string& contents)
+{
+	{
+		lock_guard<mutex> lock (mutex_);
+		auto found = contents_.find(path);
+		if (found != contents_.end()) {
+			contents = found->second;
+			return true;
+		}
+	}
+	if (!stat(path).isFile || !readSync(path, contents)) {
+		return false;
+	}
+	lock_guard<mutex> lock (mutex_);
+	contents_[path] = contents;
+	return true;
+}
+
+
+
+void FileCache::invalidate(const string& path)
+{
+	lock_guard<mutex> lock (mutex_);
+	infos_.erase(path);
+	contents_.erase(path);
+}
+
+
+
+void FileCache::prefetch(const vector<string>& statPaths, const vector<string>& readPaths)
+{
+#ifdef QTGENTOOLS_IO_URING
+	// one batch at a time in the ring, the cache is locked only to look up
+	// and publish, not during the system calls
+	lock_guard<mutex> ringLock (ringMutex_);
+	if (ioUring_) {
+		IoRing& ring = *ring_;
+		bool failed = false;
+		const size_t chunk = ring.capacity() / 2;
+
+		vector<string> paths;
+		vector<bool> reads;
+		{
+			lock_guard<mutex> lock (mutex_);
+			for (size_t i=0; i<statPaths.size(); ++i) {
+				if (infos_.find(statPaths[i]) == infos_.end()) {
+					paths.push_back(statPaths[i]);
+					reads.push_back(false);
+				}
+			}
+			for (size_t i=0; i<readPaths.size(); ++i) {
+				if (contents_.find(readPaths[i]) == contents_.end()) {
+					paths.push_back(readPaths[i]);
+					reads.push_back(true);
+				}
+			}
+		}
+
+		for (size_t start=0; start<paths.size() && !failed; start += chunk) {
+			unique_ptr<Batch> batch (new Batch(min(chunk, paths.size() - start)));
+			failed = !fetchBatch(ring, paths, reads, start, *batch);
+
+			lock_guard<mutex> lock (mutex_);
+			for (size_t i=0; i<batch->infos.size(); ++i) {
+				infos_[paths[start+i]] = batch->infos[i];
+				if (batch->read[i]) {
+					contents_[paths[start+i]].swap(batch->bufs[i]);
+				}
+			}
+			// still written by the kernel
+			if (ring.inFlight() > 0) {
+				batch.release();
+			}
+		}
+
+		// the next calls are synchronous
+		if (failed) {
+			lock_guard<mutex> lock (mutex_);
+			ring_.reset();
+			ioUring_ = false;
+		}
+		return;
+	}
+#endif
+	// synchronous path: entries are filled lazily
+	(void)statPaths;
+	(void)readPaths;
+}
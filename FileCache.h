@@ -0,0 +1,109 @@
+/*
+	Copyright (c) 2013, Remi Thebault
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+		* Redistributions of source code must retain the above copyright
+		  notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above copyright
+		  notice, this list of conditions and the following disclaimer in the
+		  documentation and/or other materials provided with the distribution.
+		* Neither the name of the <organization> nor the
+		  names of its contributors may be used to endorse or promote products
+		  derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+	DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <memory>
+
+
+// Metadata and contents of the files looked at during a run.
+// Entries are filled lazily with synchronous calls, or in batches with
+// prefetch(). On Linux, prefetch() can submit the stat, open and read
+// operations through io_uring, which saves a round trip per file on
+// network file systems. The ring is set up once, by setIoUring().
+// All the members can be called from several threads.
+class FileCache {
+public:
+
+	struct Info {
+		Info() : exists(false), isFile(false), isDir(false), mtime(0), size(0), dev(0), ino(0) {}
+
+		bool exists;
+		bool isFile;
+		bool isDir;
+		unsigned long long mtime;	// FILETIME on Windows, seconds elsewhere
+		unsigned long long size;
+		unsigned long long dev;		// identify the file whatever its path,
+		unsigned long long ino;		// 0 if unknown
+	};
+
+	FileCache();
+	~FileCache();
+
+	// true if the io_uring backend is compiled in and usable
+	static bool ioUringSupported();
+
+	// has no effect if io_uring is not supported
+	void setIoUring(bool enabled);
+	bool ioUring() const {
+		return ioUring_;
+	}
+
+	Info stat(const std::string& path);
+
+	// false if the file cannot be read, the contents are kept until
+	// clearContents() or invalidate()
+	bool read(const std::string& path, std::string& contents);
+
+	// stats statPaths, and stats and reads readPaths, in batches
+	void prefetch(const std::vector<std::string>& statPaths,
+	              const std::vector<std::string>& readPaths);
+
+	// to be called when a file was written
+	void invalidate(const std::string& path);
+
+	// drops file contents, metadata is kept
+	void clearContents() {
+		std::lock_guard<std::mutex> lock (mutex_);
+		contents_.clear();
+	}
+
+	void clear() {
+		std::lock_guard<std::mutex> lock (mutex_);
+		infos_.clear();
+		contents_.clear();
+	}
+
+	static Info statSync(const std::string& path);
+	// current time, in the unit of Info::mtime
+	static unsigned long long now();
+	static bool readSync(const std::string& path, std::string& contents);
+
+private:
+
+	class Ring;
+
+	bool ioUring_;
+	std::unique_ptr<Ring> ring_;
+	std::map<std::string, Info> infos_;
+	std::map<std::string, std::string> contents_;
+	std::mutex mutex_;
+	std::mutex ringMutex_;		// held by prefetch() during the system calls
+};
@@ -36,7 +36,10 @@
 #endif
 
 #include <string>
+#include <vector>
+#include <set>
 #include <tuple>
+#include <fstream>
 
 
 namespace fu {
@@ -103,6 +106,43 @@ namespace fu {
 	}
 
 
+	inline bool isSymlink(const std::string& path)
+	{
+#ifdef _WIN32
+		DWORD attr = GetFileAttributes(path.c_str());
+		return (attr != INVALID_FILE_ATTRIBUTES) && (attr & FILE_ATTRIBUTE_REPARSE_POINT);
+#else
+		struct stat st;
+		int res = lstat(path.c_str(), &st);
+		return (res==0 && S_ISLNK(st.st_mode));
+#endif
+	}
+
+
+#ifdef _WIN32
+	// volume serial number and file index of a file or directory, which
+	// identify it whatever its path like (st_dev, st_ino) elsewhere
+	inline bool fileId(const std::string& path, unsigned long long& dev, unsigned long long& ino)
+	{
+		// directories can only be opened with the backup semantics
+		HANDLE hFile = CreateFile(path.c_str(), 0,
+		                          FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		                          NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+		if (INVALID_HANDLE_VALUE == hFile) {
+			return false;
+		}
+		BY_HANDLE_FILE_INFORMATION info;
+		bool res = GetFileInformationByHandle(hFile, &info) != FALSE;
+		CloseHandle(hFile);
+		if (res) {
+			dev = info.dwVolumeSerialNumber;
+			ino = (static_cast<unsigned long long>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+		}
+		return res;
+	}
+#endif
+
+
 	inline bool mkDir(const std::string& path, const unsigned int& perm=0755)
 	{
 #ifdef _WIN32
@@ -124,6 +164,133 @@ namespace fu {
 
 
 
+	inline bool copyFile(const std::string& from, const std::string& to)
+	{
+#ifdef _WIN32
+		return FALSE != CopyFile(from.c_str(), to.c_str(), FALSE);
+#else
+		std::ifstream in (from, std::ios::binary);
+		std::ofstream out (to, std::ios::binary | std::ios::trunc);
+		if (!in || !out) return false;
+		// inserting an empty buffer sets the failbit
+		if (in.peek() != std::ifstream::traits_type::eof()) {
+			out << in.rdbuf();
+		}
+		return bool(out);
+#endif
+	}
+
+
+
+	inline std::string currentDir()
+	{
+		std::string dir;
+#ifdef _WIN32
+		char buf[MAX_PATH];
+		if (GetCurrentDirectory(MAX_PATH, buf)) dir = buf;
+#else
+		char buf[4096];
+		if (getcwd(buf, sizeof(buf))) dir = buf;
+#endif
+		if (dir.size() > 0 && dir.back() != pathSep) dir.push_back(pathSep);
+		return dir;
+	}
+
+
+
+	inline bool isAbsolute(const std::string& path)
+	{
+#ifdef _WIN32
+		return (path.size() > 1 && path[1] == ':') || (path.size() > 0 && (path[0] == '\\' || path[0] == '/'));
+#else
+		return path.size() > 0 && path[0] == '/';
+#endif
+	}
+
+
+
+	// path components, without the empty, "." and resolved ".." ones
+	inline std::vector<std::string> pathComponents(const std::string& path)
+	{
+		std::vector<std::string> comps;
+		size_t start = 0;
+		while (start <= path.size()) {
+			size_t end = path.find_first_of("/\\", start);
+			if (end == std::string::npos) end = path.size();
+			std::string comp = path.substr(start, end - start);
+			if (comp == "..") {
+				if (comps.size() > 0 && comps.back() != "..") comps.pop_back();
+				else comps.push_back(comp);
+			}
+			else if (comp.size() > 0 && comp != ".") {
+				comps.push_back(comp);
+			}
+			start = end + 1;
+		}
+		return comps;
+	}
+
+
+
+	// absolute path without "." and ".." components, symbolic links are kept
+	inline std::string absolutePath(const std::string& path)
+	{
+		std::string abs = isAbsolute(path) ? path : currentDir() + path;
+		std::vector<std::string> comps = pathComponents(abs);
+#ifdef _WIN32
+		std::string res;
+#else
+		std::string res (1, pathSep);
+#endif
+		for (size_t i=0; i<comps.size(); ++i) {
+			if (i > 0) res.push_back(pathSep);
+			res += comps[i];
+		}
+		return res;
+	}
+
+
+
+	// the root directory, or a drive root on Windows
+	inline bool isRoot(const std::string& path)
+	{
+#ifdef _WIN32
+		return pathComponents(absolutePath(path)).size() <= 1;
+#else
+		return pathComponents(absolutePath(path)).empty();
+#endif
+	}
+
+
+
+	// path relative to the base directory, both made absolute
+	inline std::string relativePath(const std::string& path, const std::string& base)
+	{
+		std::vector<std::string> to = pathComponents(absolutePath(path));
+		std::vector<std::string> from = pathComponents(absolutePath(base));
+
+		size_t common = 0;
+		while (common < to.size() && common < from.size() && to[common] == from[common]) {
+			++common;
+		}
+#ifdef _WIN32
+		// on another drive
+		if (common == 0) return absolutePath(path);
+#endif
+		std::vector<std::string> comps (from.size() - common, std::string(".."));
+		comps.insert(comps.end(), to.begin() + common, to.end());
+		if (comps.empty()) return std::string(".");
+
+		std::string res = comps[0];
+		for (size_t i=1; i<comps.size(); ++i) {
+			res.push_back(pathSep);
+			res += comps[i];
+		}
+		return res;
+	}
+
+
+
 	template<typename CharT>
 	std::basic_string<CharT> parentDir(const std::basic_string<CharT>& path)
 	{
@@ -203,8 +370,25 @@ namespace fu {
 
 
 
+	// what a walk does with symbolic links (and junctions on Windows)
+	enum SymlinkPolicy {
+		FollowSymlinks,		// walked as the files and directories they point to
+		SkipSymlinks		// ignored
+	};
+
+	// (device, inode) of the directories walked
+	typedef std::set<std::pair<unsigned long long, unsigned long long> > DirIds;
+	// symbolic links found by a walk, as (directory, name)
+	typedef std::vector<std::pair<std::string, std::string> > DirLinks;
+
+
+
+	// Walks a directory without following its symbolic links, they are
+	// added to links instead. A directory already in walked is not walked
+	// again.
 	template<class ActionT>
-	void walk(std::string root, ActionT& action, bool reportDirs=false)
+	void walkDir(std::string root, ActionT& action, bool reportDirs,
+	             SymlinkPolicy symlinks, DirIds& walked, DirLinks& links)
 	{
 
 		if (root.back() != pathSep) root.push_back(pathSep);
@@ -213,6 +397,12 @@ namespace fu {
 		WIN32_FIND_DATA ffd;
 		HANDLE hFile;
 
+		unsigned long long dev;
+		unsigned long long ino;
+		if (!fileId(root, dev, ino) || !walked.insert(std::make_pair(dev, ino)).second) {
+			return;
+		}
+
 		std::string rootPattern = root;
 		rootPattern.push_back('*');
 
@@ -225,11 +415,18 @@ namespace fu {
 			std::string filename = std::string(ffd.cFileName);
 			if (filename.front() == '.') continue;
 
+			if (ffd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) {
+				if (symlinks == FollowSymlinks) {
+					links.push_back(std::make_pair(root, filename));
+				}
+				continue;
+			}
+
 			if (ffd.dwFileAttributes == FILE_ATTRIBUTE_DIRECTORY) {
 				if (reportDirs) {
 					action(root, filename, true);
 				}
-				walk(root + filename, action, reportDirs);
+				walkDir(root + filename, action, reportDirs, symlinks, walked, links);
 			}
 			else {
 				action(root, filename, false);
@@ -242,6 +439,14 @@ namespace fu {
 		DIR *dp;
 		dp = opendir(root.c_str());
 		if (dp != NULL) {
+			struct stat st;
+			if (fstat(dirfd(dp), &st) != 0 ||
+			        !walked.insert(std::make_pair((unsigned long long)st.st_dev,
+			                                      (unsigned long long)st.st_ino)).second) {
+				closedir(dp);
+				return;
+			}
+
 			struct dirent *ep;
 			while ((ep = readdir(dp))) {
 				if (ep->d_name[0] == '.') continue;
@@ -249,11 +454,32 @@ namespace fu {
 				std::string path(ep->d_name);
 				std::string completePath = root + path;
 
-				if (isDir(completePath)) {
+				// the entry type saves a stat call when the file system reports it
+#ifdef _DIRENT_HAVE_D_TYPE
+				bool dir = ep->d_type == DT_DIR;
+				bool link = ep->d_type == DT_LNK;
+				bool known = dir || link || ep->d_type == DT_REG;
+#else
+				bool dir = false;
+				bool link = false;
+				bool known = false;
+#endif
+				if (!known) {
+					if (lstat(completePath.c_str(), &st) != 0) continue;
+					dir = S_ISDIR(st.st_mode);
+					link = S_ISLNK(st.st_mode);
+				}
+
+				if (link) {
+					if (symlinks == FollowSymlinks) {
+						links.push_back(std::make_pair(root, path));
+					}
+				}
+				else if (dir) {
 					if (reportDirs) {
 						action(root, path, true);
 					}
-					walk(root + path, action, reportDirs);
+					walkDir(root + path, action, reportDirs, symlinks, walked, links);
 				}
 				else {
 					action(root, path, false);
@@ -264,4 +490,34 @@ namespace fu {
 #endif
 	}
 
+
+
+	// The symbolic links are followed once the other entries are walked, so
+	// that a file reached through several paths is found first by its real
+	// path. A directory reached again through a link is not walked twice,
+	// which also ends the symbolic link loops.
+	template<class ActionT>
+	void walk(std::string root, ActionT& action, bool reportDirs=false,
+	          SymlinkPolicy symlinks=FollowSymlinks)
+	{
+		DirIds walked;
+		DirLinks links;
+		walkDir(root, action, reportDirs, symlinks, walked, links);
+
+		// links grows while the linked directories are walked
+		for (size_t i=0; i<links.size(); ++i) {
+			std::string dir = links[i].first;
+			std::string name = links[i].second;
+			if (isDir(dir + name)) {
+				if (reportDirs) {
+					action(dir, name, true);
+				}
+				walkDir(dir + name, action, reportDirs, symlinks, walked, links);
+			}
+			else {
+				action(dir, name, false);
+			}
+		}
+	}
+
 }
@@ -0,0 +1,600 @@
+/*
+	Copyright (c) 2013, Remi Thebault
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+		* Redistributions of source code must retain the above copyright
+		  notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above copyright
+		  notice, this list of conditions and the following disclaimer in the
+		  documentation and/or other materials provided with the distribution.
+		* Neither the name of the <organization> nor the
+		  names of its contributors may be used to endorse or promote products
+		  derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+	DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "GitIndex.h"
+#include "FileCache.h"
+#include "StringUtils.h"
+
+#include <cstdlib>
+#include <climits>
+#include <algorithm>
+
+
+using namespace std;
+
+
+
+namespace {
+
+	unsigned readUInt32(const string& data, size_t pos)
+	{
+		const unsigned char *p = reinterpret_cast<const unsigned char *>(data.data() + pos);
+		return (unsigned(p[0]) << 24) | (unsigned(p[1]) << 16) | (unsigned(p[2]) << 8) | p[3];
+	}
+
+	unsigned readUInt16(const string& data, size_t pos)
+	{
+		const unsigned char *p = reinterpret_cast<const unsigned char *>(data.data() + pos);
+		return (unsigned(p[0]) << 8) | p[1];
+	}
+
+	unsigned long long readUInt64(const string& data, size_t pos)
+	{
+		return (static_cast<unsigned long long>(readUInt32(data, pos)) << 32) | readUInt32(data, pos + 4);
+	}
+
+	// variable length integer of the version 4 path compression and of
+	// the untracked cache
+	bool readOffset(const string& data, size_t& pos, size_t& value)
+	{
+		if (pos >= data.size()) return false;
+		unsigned char c = data[pos++];
+		value = c & 0x7f;
+		while (c & 0x80) {
+			if (pos >= data.size()) return false;
+			c = data[pos++];
+			value = ((value + 1) << 7) | (c & 0x7f);
+		}
+		return true;
+	}
+
+	// stat data of the untracked cache: ctime, mtime, dev, ino, uid, gid, size
+	const size_t untrackedStatSize = 36;
+
+	void readStat(const string& data, size_t pos, GitIndex::StatData& stat, size_t sizeOffset)
+	{
+		stat.mtime = readUInt32(data, pos + 8);
+		stat.mtimeNs = readUInt32(data, pos + 12);
+		stat.size = readUInt32(data, pos + sizeOffset);
+	}
+
+	// empty for a null hash
+	string readHash(const string& data, size_t pos, size_t hashSize)
+	{
+		string hash = data.substr(pos, hashSize);
+		return (hash.find_first_not_of('\0') == string::npos) ? string() : hash;
+	}
+
+	// EWAH compressed bitmap: bit count, word count, 64 bit words, and the
+	// position of the last run length word
+	bool readBitmap(const string& data, size_t& pos, size_t end, vector<bool>& bits)
+	{
+		if (pos + 8 > end) return false;
+		size_t bitCount = readUInt32(data, pos);
+		size_t wordCount = readUInt32(data, pos + 4);
+		pos += 8;
+		if (wordCount > (end - pos) / 8 || pos + wordCount * 8 + 4 > end) return false;
+
+		bits.clear();
+		size_t word = 0;
+		while (word < wordCount) {
+			// run length word: the running bit, its count of 64 bit words,
+			// then the count of literal words following
+			unsigned long long rlw = readUInt64(data, pos + 8 * word++);
+			unsigned long long running = (rlw >> 1) & 0xffffffffULL;
+			size_t literals = size_t(rlw >> 33);
+			if (running > (bitCount + 63) / 64 || literals > wordCount - word) return false;
+			bits.insert(bits.end(), size_t(running) * 64, (rlw & 1) != 0);
+			for (size_t i=0; i<literals; ++i) {
+				unsigned long long literal = readUInt64(data, pos + 8 * word++);
+				for (unsigned b=0; b<64; ++b) {
+					bits.push_back(((literal >> b) & 1) != 0);
+				}
+			}
+		}
+		pos += wordCount * 8 + 4;
+		bits.resize(bitCount, false);
+		return true;
+	}
+
+	// a directory of the untracked cache and its sub-directories
+	bool readUntrackedDir(const string& data, size_t& pos, size_t end,
+	                      vector<GitIndex::UntrackedDir>& dirs)
+	{
+		GitIndex::UntrackedDir dir;
+		size_t count;
+		if (!readOffset(data, pos, count) || !readOffset(data, pos, dir.dirCount)) return false;
+		for (size_t i=0; i<=count; ++i) {
+			size_t nul = data.find('\0', pos);
+			if (nul == string::npos || nul >= end) return false;
+			if (i == 0) dir.name = data.substr(pos, nul - pos);
+			else dir.untracked.push_back(data.substr(pos, nul - pos));
+			pos = nul + 1;
+		}
+		size_t dirCount = dir.dirCount;
+		dirs.push_back(dir);
+		for (size_t i=0; i<dirCount; ++i) {
+			if (!readUntrackedDir(data, pos, end, dirs)) return false;
+		}
+		return true;
+	}
+
+	bool parseUntracked(const string& data, size_t hashSize, GitIndex::UntrackedCache& cache)
+	{
+		if (data.empty() || data.back() != '\0') return false;
+		size_t end = data.size() - 1;
+
+		size_t pos = 0;
+		size_t identSize;
+		if (!readOffset(data, pos, identSize) || identSize > end - pos) return false;
+		cache.ident = data.substr(pos, identSize);
+		pos += identSize;
+
+		// the stat data of info/exclude and core.excludesFile, the flags of
+		// the directory walk, their hashes, and the per directory exclude file
+		if (pos + 2 * untrackedStatSize + 4 + 2 * hashSize > end) return false;
+		readStat(data, pos, cache.infoExclude, 32);
+		readStat(data, pos + untrackedStatSize, cache.excludesFile, 32);
+		pos += 2 * untrackedStatSize + 4;
+		cache.infoExcludeHash = readHash(data, pos, hashSize);
+		cache.excludesFileHash = readHash(data, pos + hashSize, hashSize);
+		pos += 2 * hashSize;
+		size_t nul = data.find('\0', pos);
+		cache.excludePerDir = data.substr(pos, nul - pos);
+		pos = nul + 1;
+		if (pos >= end) return true;
+
+		size_t count;
+		if (!readOffset(data, pos, count)) return false;
+		if (count == 0) return true;
+		if (!readUntrackedDir(data, pos, end, cache.dirs) || cache.dirs.size() != count) return false;
+
+		vector<bool> valid, checkOnly, hashed;
+		if (!readBitmap(data, pos, end, valid) || !readBitmap(data, pos, end, checkOnly) ||
+		        !readBitmap(data, pos, end, hashed)) {
+			return false;
+		}
+		if (valid.size() > count || checkOnly.size() > count || hashed.size() > count) return false;
+		valid.resize(count);
+		checkOnly.resize(count);
+		hashed.resize(count);
+
+		// the stat data of the valid directories, then the hashes of their
+		// exclude files, in the order of the directories
+		for (size_t i=0; i<count; ++i) {
+			cache.dirs[i].checkOnly = checkOnly[i];
+			if (!valid[i]) continue;
+			if (pos + untrackedStatSize > end) return false;
+			readStat(data, pos, cache.dirs[i].stat, 32);
+			cache.dirs[i].valid = true;
+			pos += untrackedStatSize;
+		}
+		for (size_t i=0; i<count; ++i) {
+			if (!hashed[i]) continue;
+			if (pos + hashSize > end) return false;
+			cache.dirs[i].excludeHash = data.substr(pos, hashSize);
+			pos += hashSize;
+		}
+		return true;
+	}
+
+	// current stat data of a file, in the form git caches it
+	bool statOf(const string& path, GitIndex::StatData& stat)
+	{
+#ifdef _WIN32
+		struct _stat64 st;
+		if (_stat64(path.c_str(), &st) != 0) return false;
+		stat.mtimeNs = 0;
+#else
+		struct stat st;
+		if (lstat(path.c_str(), &st) != 0) return false;
+#ifdef __APPLE__
+		stat.mtimeNs = unsigned(st.st_mtimespec.tv_nsec);
+#else
+		stat.mtimeNs = unsigned(st.st_mtim.tv_nsec);
+#endif
+#endif
+		stat.mtime = unsigned(st.st_mtime);
+		stat.size = unsigned(st.st_size);
+		return true;
+	}
+
+	// Whether the file still has the stat data git cached. Not if racy:
+	// modified in the second the index was written, or after.
+	bool statMatches(const string& path, const GitIndex::StatData& cached, unsigned indexMtime)
+	{
+		GitIndex::StatData stat;
+		if (!statOf(path, stat)) return false;
+		return stat.mtime == cached.mtime && stat.size == cached.size &&
+		       (cached.mtimeNs == 0 || stat.mtimeNs == 0 || stat.mtimeNs == cached.mtimeNs) &&
+		       cached.mtime < indexMtime;
+	}
+
+	// core.excludesFile, from the repository or the user config, or the
+	// default one
+	string excludesFilePath(const string& repoConfig)
+	{
+		const char *home = getenv("HOME");
+		const char *xdg = getenv("XDG_CONFIG_HOME");
+		string xdgDir = xdg ? string(xdg) : (home ? string(home) + "/.config" : string());
+
+		vector<string> configs (1, repoConfig);
+		string contents;
+		if (xdgDir.size() > 0 && FileCache::readSync(xdgDir + "/git/config", contents)) {
+			configs.push_back(contents);
+		}
+		if (home && FileCache::readSync(string(home) + "/.gitconfig", contents)) {
+			configs.push_back(contents);
+		}
+
+		// the first config setting it, the repository one first
+		string path;
+		for (size_t c=0; c<configs.size() && path.empty(); ++c) {
+			string config = configs[c];
+			transform(config.begin(), config.end(), config.begin(), ::tolower);
+			size_t key = config.rfind("excludesfile");
+			if (key == string::npos) continue;
+			size_t eq = configs[c].find('=', key);
+			size_t eol = configs[c].find('\n', key);
+			if (eq == string::npos || eq > eol) continue;
+			path = configs[c].substr(eq + 1, eol == string::npos ? string::npos : eol - eq - 1);
+			su::trim(path);
+			if (path.size() > 1 && path[0] == '"' && path.back() == '"') {
+				path = path.substr(1, path.size() - 2);
+			}
+		}
+
+		if (path.empty()) {
+			return xdgDir.empty() ? string() : xdgDir + "/git/ignore";
+		}
+		if (su::beginsWith(path, string("~/")) && home) {
+			path = string(home) + path.substr(1);
+		}
+		return path;
+	}
+
+
+
+	string absolutePath(const string& path)
+	{
+#ifdef _WIN32
+		char buf[MAX_PATH];
+		if (!_fullpath(buf, path.c_str(), MAX_PATH)) return string();
+#else
+		char buf[PATH_MAX];
+		if (!realpath(path.c_str(), buf)) return string();
+#endif
+		string res (buf);
+		if (res.back() != fu::pathSep) res.push_back(fu::pathSep);
+		return res;
+	}
+
+	// a directory read from a git file, relative to base or absolute
+	string resolveDir(const string& base, string dir)
+	{
+		su::trim(dir);
+#ifdef _WIN32
+		bool absolute = dir.size() > 1 && dir[1] == ':';
+#else
+		bool absolute = dir.size() > 0 && dir[0] == '/';
+#endif
+		if (!absolute) dir = base + dir;
+		if (dir.back() != fu::pathSep && dir.back() != '/') dir.push_back(fu::pathSep);
+		return dir;
+	}
+
+	// git directory of a work tree: .git, or the one a .git file points to
+	string gitDir(const string& workTree)
+	{
+		string dotGit = workTree + ".git";
+		if (fu::isDir(dotGit)) {
+			return dotGit + fu::pathSep;
+		}
+		string contents;
+		if (!FileCache::readSync(dotGit, contents) || !su::beginsWith(contents, string("gitdir:"))) {
+			return string();
+		}
+		return resolveDir(workTree, contents.substr(7));
+	}
+
+	// directory holding the config of a git directory: the one its
+	// commondir file points to for a linked work tree
+	string commonDir(const string& git)
+	{
+		string contents;
+		if (!FileCache::readSync(git + "commondir", contents)) {
+			return git;
+		}
+		return resolveDir(git, contents);
+	}
+
+	bool untrackedCacheMatches(const GitIndex::UntrackedCache& cache, const string& workTree,
+	                           const string& commonDir, const string& config,
+	                           unsigned indexMtime)
+	{
+		// written for this work tree, the exclude files not changed since
+		string location = workTree.substr(0, workTree.size() - 1);
+		replace(location.begin(), location.end(), '\\', '/');
+		if (!su::beginsWith(cache.ident, "Location " + location + ", ")) {
+			return false;
+		}
+
+		// added ignore patterns only hide files, a new exclude file is fine
+		string infoExclude = commonDir + "info" + fu::pathSep + "exclude";
+		if (cache.infoExcludeHash.size() > 0 && !statMatches(infoExclude, cache.infoExclude, indexMtime)) {
+			return false;
+		}
+		if (cache.excludesFileHash.size() > 0) {
+			string excludesFile = excludesFilePath(config);
+			if (excludesFile.empty() || !statMatches(excludesFile, cache.excludesFile, indexMtime)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// the directory after the sub-directories of dirs[i]
+	size_t nextSibling(const vector<GitIndex::UntrackedDir>& dirs, size_t i)
+	{
+		size_t left = 1;
+		while (left > 0 && i < dirs.size()) {
+			left += dirs[i].dirCount;
+			--left;
+			++i;
+		}
+		return i;
+	}
+
+}
+
+
+
+bool GitIndex::parse(const string& contents, size_t hashSize, vector<Entry>& entries,
+                     UntrackedCache *untracked)
+{
+	if (untracked) *untracked = UntrackedCache();
+	if (contents.size() < 12 || contents.compare(0, 4, "DIRC") != 0) {
+		return false;
+	}
+	unsigned version = readUInt32(contents, 4);
+	if (version < 2 || version > 4) {
+		return false;
+	}
+	unsigned count = readUInt32(contents, 8);
+
+	// ctime, mtime, dev, ino, mode, uid, gid, size, then the object hash
+	const size_t statSize = 40;
+	const size_t modeOffset = 24;
+	const size_t sizeOffset = 36;
+
+	size_t pos = 12;
+	string name;
+	for (unsigned i=0; i<count; ++i) {
+		size_t start = pos;
+		if (pos + statSize + hashSize + 2 > contents.size()) return false;
+		Entry entry;
+		readStat(contents, pos, entry.stat, sizeOffset);
+		unsigned mode = readUInt32(contents, pos + modeOffset);
+		entry.hash = contents.substr(pos + statSize, hashSize);
+		pos += statSize + hashSize;
+		unsigned flags = readUInt16(contents, pos);
+		pos += 2;
+		if (flags & 0x4000) {
+			if (version < 3 || pos + 2 > contents.size()) return false;
+			pos += 2;
+		}
+
+		if (version == 4) {
+			size_t strip;
+			if (!readOffset(contents, pos, strip) || strip > name.size()) return false;
+			size_t end = contents.find('\0', pos);
+			if (end == string::npos) return false;
+			name = name.substr(0, name.size() - strip) + contents.substr(pos, end - pos);
+			pos = end + 1;
+		}
+		else {
+			size_t end = contents.find('\0', pos);
+			if (end == string::npos) return false;
+			name = contents.substr(pos, end - pos);
+			// entries are padded with 1 to 8 nul bytes to a multiple of 8
+			pos = start + ((end - start + 8) & ~size_t(7));
+		}
+
+		// regular files and symbolic links only, not gitlinks nor the
+		// directories of a sparse index
+		unsigned type = mode & 0170000;
+		if (type != 0100000 && type != 0120000) continue;
+		// conflicting stages of a same path follow each other
+		if (entries.size() > 0 && entries.back().path == name) continue;
+		entry.path = name;
+		entry.link = (type == 0120000);
+		entries.push_back(entry);
+	}
+
+	// the entries of a split index are in another file, an unreadable
+	// untracked cache is not used
+	while (pos + 8 <= contents.size() - min(contents.size(), hashSize)) {
+		size_t size = readUInt32(contents, pos + 4);
+		if (contents.compare(pos, 4, "link") == 0) {
+			return false;
+		}
+		if (untracked && contents.compare(pos, 4, "UNTR") == 0 && size <= contents.size() - pos - 8 &&
+		        !parseUntracked(contents.substr(pos + 8, size), hashSize, *untracked)) {
+			*untracked = UntrackedCache();
+		}
+		pos += 8 + size;
+	}
+	return true;
+}
+
+
+
+bool GitIndex::load(const string& dir)
+{
+	files_.clear();
+	tracked_.clear();
+	links_.clear();
+	dirs_.clear();
+	untracked_.clear();
+
+	string absDir = absolutePath(dir);
+	if (absDir.empty()) {
+		return false;
+	}
+
+	// the work tree is the closest parent with a .git entry
+	string workTree = absDir;
+	string git;
+	while (true) {
+		git = gitDir(workTree);
+		if (git.size() > 0) break;
+		string parent = fu::parentDir(workTree);
+		if (parent.size() == 0 || parent == workTree) return false;
+		workTree = parent;
+	}
+
+	string contents;
+	if (!FileCache::readSync(git + "index", contents)) {
+		return false;
+	}
+
+	string common = commonDir(git);
+	string config;
+	FileCache::readSync(common + "config", config);
+	size_t format = config.find("objectformat");
+	size_t hashSize = (format != string::npos && config.find("sha256", format) != string::npos) ? 32 : 20;
+
+	vector<Entry> entries;
+	UntrackedCache cache;
+	if (!parse(contents, hashSize, entries, &cache)) {
+		return false;
+	}
+
+	string prefix = absDir.substr(workTree.size());
+	replace(prefix.begin(), prefix.end(), fu::pathSep, '/');
+
+	dirs_.insert(string());
+	for (size_t i=0; i<entries.size(); ++i) {
+		if (!su::beginsWith(entries[i].path, prefix)) continue;
+		string relPath = entries[i].path.substr(prefix.size());
+		// hidden files and directories are not walked either
+		if (relPath[0] == '.' || relPath.find("/.") != string::npos) continue;
+
+		replace(relPath.begin(), relPath.end(), '/', fu::pathSep);
+		if (!tracked_.insert(relPath).second) continue;
+		files_.push_back(relPath);
+		if (entries[i].link) links_.insert(relPath);
+
+		size_t sep = 0;
+		while ((sep = relPath.find(fu::pathSep, sep)) != string::npos) {
+			++sep;
+			dirs_.insert(relPath.substr(0, sep));
+		}
+	}
+
+	StatData index;
+	if (cache.dirs.size() > 0 && statOf(git + "index", index) &&
+	        untrackedCacheMatches(cache, workTree, common, config, index.mtime)) {
+		loadUntracked(cache, entries, workTree, prefix, index.mtime);
+	}
+	return true;
+}
+
+
+
+void GitIndex::loadUntracked(const UntrackedCache& cache, const vector<Entry>& entries,
+                             const string& workTree, const string& prefix, unsigned indexMtime)
+{
+	// the per directory exclude files are compared with their tracked version
+	map<string, const Entry *> excludeFiles;
+	for (size_t i=0; i<entries.size(); ++i) {
+		const string& path = entries[i].path;
+		size_t sep = path.rfind('/');
+		if (path.compare(sep == string::npos ? 0 : sep + 1, string::npos, cache.excludePerDir) == 0) {
+			excludeFiles[path] = &entries[i];
+		}
+	}
+
+	// path and unchanged exclude files of the parent of each directory
+	vector<pair<string, bool> > parents (1, make_pair(string(), true));
+	vector<size_t> left (1, 1);
+	for (size_t i=0; i<cache.dirs.size(); ++i) {
+		while (left.back() == 0) {
+			parents.pop_back();
+			left.pop_back();
+		}
+		--left.back();
+
+		const UntrackedDir& dir = cache.dirs[i];
+		string path = (i == 0) ? string() : parents.back().first + dir.name + '/';
+
+		// a changed exclude file can make ignored files of the directory
+		// and its sub-directories untracked
+		bool excludesMatch = parents.back().second;
+		if (excludesMatch && dir.excludeHash.size() > 0) {
+			auto found = excludeFiles.find(path + cache.excludePerDir);
+			excludesMatch = found != excludeFiles.end() && found->second->hash == dir.excludeHash &&
+			                statMatches(workTree + path + cache.excludePerDir,
+			                            found->second->stat, indexMtime);
+		}
+		parents.push_back(make_pair(path, excludesMatch));
+		left.push_back(dir.dirCount);
+
+		// a directory modified since git listed it is listed again
+		if (!excludesMatch || !dir.valid || dir.checkOnly || !su::beginsWith(path, prefix) ||
+		        !statMatches(workTree + path, dir.stat, indexMtime)) {
+			continue;
+		}
+		string relDir = path.substr(prefix.size());
+		if (relDir.size() > 0 && (relDir[0] == '.' || relDir.find("/.") != string::npos)) {
+			continue;
+		}
+		replace(relDir.begin(), relDir.end(), '/', fu::pathSep);
+
+		Untracked& untracked = untracked_[relDir];
+		set<string> subDirs;
+		for (size_t j=0; j<dir.untracked.size(); ++j) {
+			string name = dir.untracked[j];
+			if (name[0] == '.') continue;
+			if (name.back() == '/') {
+				name.back() = fu::pathSep;
+				subDirs.insert(name);
+			}
+			else {
+				untracked.files.push_back(name);
+			}
+		}
+
+		// untracked directories listed in full by git only have their own entry
+		for (size_t j=i+1, sub=0; sub<dir.dirCount; ++sub) {
+			if (cache.dirs[j].name[0] != '.') {
+				subDirs.insert(cache.dirs[j].name + fu::pathSep);
+			}
+			j = nextSibling(cache.dirs, j);
+		}
+		untracked.dirs.assign(subDirs.begin(), subDirs.end());
+	}
+}
@@ -0,0 +1,211 @@
+/*
+	Copyright (c) 2013, Remi Thebault
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+		* Redistributions of source code must retain the above copyright
+		  notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above copyright
+		  notice, this list of conditions and the following disclaimer in the
+		  documentation and/or other materials provided with the distribution.
+		* Neither the name of the <organization> nor the
+		  names of its contributors may be used to endorse or promote products
+		  derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+	DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "FileUtils.h"
+
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+
+
+// Files of a directory known to the git repository it belongs to, read
+// from the repository index (.git/index, versions 2 to 4) without running
+// git. The untracked files are taken from the untracked cache extension
+// of the index (core.untrackedCache), for the directories whose cached
+// stat data and exclude files still match. The other directories having
+// tracked files are listed, and the untracked directories walked.
+class GitIndex {
+public:
+
+	// stat data cached by git, of a file or a directory
+	struct StatData {
+		StatData() : mtime(0), mtimeNs(0), size(0) {}
+
+		unsigned mtime;
+		unsigned mtimeNs;
+		unsigned size;
+	};
+
+	// an entry of the index
+	struct Entry {
+		Entry() : link(false) {}
+
+		std::string path;		// relative to the work tree, '/' separated
+		bool link;				// symbolic link
+		StatData stat;
+		std::string hash;		// object id, binary
+	};
+
+	// a directory of the untracked cache, they are in depth first order
+	struct UntrackedDir {
+		UntrackedDir() : dirCount(0), valid(false), checkOnly(false) {}
+
+		std::string name;		// relative to the parent directory, empty for the root
+		size_t dirCount;		// sub-directories following it
+		std::vector<std::string> untracked;	// directories end with '/'
+		bool valid;				// untracked is complete as of stat
+		bool checkOnly;			// untracked only tells whether there is one
+		StatData stat;			// of the directory
+		std::string excludeHash;	// of its per directory exclude file, empty if none
+	};
+
+	// the untracked cache extension (UNTR)
+	struct UntrackedCache {
+		std::string ident;		// work tree location and system name
+		StatData infoExclude;	// of $GIT_DIR/info/exclude
+		std::string infoExcludeHash;	// empty if it did not exist
+		StatData excludesFile;	// of core.excludesFile
+		std::string excludesFileHash;
+		std::string excludePerDir;	// .gitignore
+		std::vector<UntrackedDir> dirs;
+	};
+
+	// Reads the index of the repository containing dir.
+	// False if there is none, or if the index is not supported (split index).
+	bool load(const std::string& dir);
+
+	// tracked files under the directory, relative to it
+	const std::vector<std::string>& files() const {
+		return files_;
+	}
+
+	// same as fu::walk, for the tracked files and the untracked files
+	template<class ActionT>
+	void walk(std::string root, ActionT& action,
+	          fu::SymlinkPolicy symlinks = fu::FollowSymlinks);
+
+	// Parses the index contents. The untracked cache is cleared, and filled
+	// if untracked is not NULL and the index has one.
+	static bool parse(const std::string& contents, size_t hashSize,
+	                  std::vector<Entry>& entries,
+	                  UntrackedCache *untracked = NULL);
+
+private:
+
+	// untracked entries of a directory the cache is up to date for
+	struct Untracked {
+		std::vector<std::string> files;
+		std::vector<std::string> dirs;		// ending with a separator
+	};
+
+	// keeps the directories the untracked cache is up to date for
+	void loadUntracked(const UntrackedCache& cache, const std::vector<Entry>& entries,
+	                   const std::string& workTree, const std::string& prefix,
+	                   unsigned indexMtime);
+
+	template<class ActionT>
+	void walkUntracked(const std::string& root, const std::string& dir, ActionT& action,
+	                   fu::SymlinkPolicy symlinks);
+
+	std::vector<std::string> files_;
+	std::set<std::string> tracked_;
+	std::set<std::string> links_;		// tracked symbolic links
+	std::set<std::string> dirs_;		// relative, ending with a separator, or empty
+	std::map<std::string, Untracked> untracked_;	// by directory, as dirs_
+};
+
+
+
+template<class ActionT>
+void GitIndex::walk(std::string root, ActionT& action, fu::SymlinkPolicy symlinks)
+{
+	if (root.back() != fu::pathSep) root.push_back(fu::pathSep);
+
+	for (size_t i=0; i<files_.size(); ++i) {
+		if (symlinks == fu::SkipSymlinks && links_.find(files_[i]) != links_.end()) {
+			continue;
+		}
+		size_t sep = files_[i].rfind(fu::pathSep);
+		size_t split = (sep == std::string::npos) ? 0 : sep+1;
+		action(root + files_[i].substr(0, split), files_[i].substr(split), false);
+	}
+
+	for (auto it = dirs_.begin(); it != dirs_.end(); ++it) {
+		if (untracked_.find(*it) != untracked_.end()) {
+			walkUntracked(root, *it, action, symlinks);
+			continue;
+		}
+
+		// not in the untracked cache, or changed since
+		std::vector<std::string> names;
+		fu::listDir(root + *it, std::back_inserter(names), true);
+		for (size_t i=0; i<names.size(); ++i) {
+			std::string relPath = *it + names[i];
+			if (tracked_.find(relPath) != tracked_.end() ||
+			        dirs_.find(relPath + fu::pathSep) != dirs_.end()) {
+				continue;
+			}
+			if (symlinks == fu::SkipSymlinks && fu::isSymlink(root + relPath)) {
+				continue;
+			}
+			if (fu::isFile(root + relPath)) {
+				action(root + *it, names[i], false);
+			}
+			else if (fu::isDir(root + relPath)) {
+				// untracked directory, unknown to the index
+				fu::walk(root + relPath, action, false, symlinks);
+			}
+		}
+	}
+}
+
+
+
+template<class ActionT>
+void GitIndex::walkUntracked(const std::string& root, const std::string& dir, ActionT& action,
+                             fu::SymlinkPolicy symlinks)
+{
+	const Untracked& untracked = untracked_.find(dir)->second;
+	for (size_t i=0; i<untracked.files.size(); ++i) {
+		// git lists the symbolic links to directories as files
+		std::string path = root + dir + untracked.files[i];
+		if (fu::isSymlink(path)) {
+			if (symlinks == fu::SkipSymlinks) {
+				continue;
+			}
+			if (fu::isDir(path)) {
+				fu::walk(path, action, false, symlinks);
+				continue;
+			}
+		}
+		action(root + dir, untracked.files[i], false);
+	}
+	for (size_t i=0; i<untracked.dirs.size(); ++i) {
+		std::string relPath = dir + untracked.dirs[i];
+		if (dirs_.find(relPath) != dirs_.end()) {
+			continue;
+		}
+		if (untracked_.find(relPath) != untracked_.end()) {
+			walkUntracked(root, relPath, action, symlinks);
+		}
+		else if (fu::isDir(root + relPath)) {
+			fu::walk(root + relPath, action, false, symlinks);
+		}
+	}
+}
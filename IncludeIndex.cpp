@@ -0,0 +1,226 @@
+/*
+	Copyright (c) 2013, Remi Thebault
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+		* Redistributions of source code must retain the above copyright
+		  notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above copyright
+		  notice, this list of conditions and the following disclaimer in the
+		  documentation and/or other materials provided with the distribution.
+		* Neither the name of the <organization> nor the
+		  names of its contributors may be used to endorse or promote products
+		  derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+	DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "IncludeIndex.h"
+#include "StringUtils.h"
+
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+
+
+using namespace std;
+
+
+
+namespace {
+
+	const char *indexHeader = "qtgentools-index 2";
+
+	const char *sourceExts[] = {
+		".c", ".cc", ".cpp", ".cxx", ".h", ".hh", ".hpp", ".hxx", ".mm"
+	};
+
+}
+
+
+
+void IncludeIndex::load(const string& path)
+{
+	sources_.clear();
+	consumers_.clear();
+	changed_ = true;
+
+	ifstream in (path);
+	string line;
+	if (!getline(in, line) || line != indexHeader) {
+		return;
+	}
+
+	// source \t mtime \t size [\t include]...
+	while (getline(in, line)) {
+		vector<string> fields;
+		su::split(line, '\t', back_inserter(fields));
+		if (fields.size() < 3) {
+			return;
+		}
+		Source& source = sources_[fields[0]];
+		source.mtime = strtoull(fields[1].c_str(), NULL, 10);
+		source.size = strtoull(fields[2].c_str(), NULL, 10);
+		source.includes.assign(fields.begin() + 3, fields.end());
+		for (size_t i=0; i<source.includes.size(); ++i) {
+			consumers_[source.includes[i]].insert(fields[0]);
+		}
+	}
+	changed_ = false;
+}
+
+
+
+bool IncludeIndex::save(const string& path)
+{
+	if (!changed_) {
+		return true;
+	}
+
+	ostringstream buf;
+	buf << indexHeader << '\n';
+	for (auto it = sources_.begin(); it != sources_.end(); ++it) {
+		buf << it->first << '\t' << it->second.mtime << '\t' << it->second.size;
+		for (size_t i=0; i<it->second.includes.size(); ++i) {
+			buf << '\t' << it->second.includes[i];
+		}
+		buf << '\n';
+	}
+
+	ofstream out (path, ios::binary | ios::trunc);
+	out << buf.str();
+	if (!out) {
+		return false;
+	}
+	changed_ = false;
+	return true;
+}
+
+
+
+bool IncludeIndex::isSource(const string& filename)
+{
+	for (size_t i=0; i<sizeof(sourceExts)/sizeof(sourceExts[0]); ++i) {
+		if (su::endsWith(filename, string(sourceExts[i]))) {
+			return true;
+		}
+	}
+	return false;
+}
+
+
+
+void IncludeIndex::update(const vector<string>& sources, FileCache& files, bool complete)
+{
+	files.prefetch(sources, vector<string>());
+
+	// only the new and modified sources are read
+	vector<string> reads;
+	for (size_t i=0; i<sources.size(); ++i) {
+		FileCache::Info info = files.stat(sources[i]);
+		auto found = sources_.find(sources[i]);
+		if (found == sources_.end() ||
+		        found->second.mtime != info.mtime || found->second.size != info.size) {
+			reads.push_back(sources[i]);
+		}
+	}
+
+	const size_t chunk = 512;
+	for (size_t i=0; i<reads.size(); i += chunk) {
+		vector<string> batch (reads.begin() + i, reads.begin() + min(reads.size(), i + chunk));
+		files.prefetch(vector<string>(), batch);
+
+		for (size_t j=0; j<batch.size(); ++j) {
+			FileCache::Info info = files.stat(batch[j]);
+			Source source;
+			source.mtime = info.mtime;
+			source.size = info.size;
+
+			string contents;
+			files.read(batch[j], contents);
+			source.includes = parseIncludes(contents);
+
+			sources_[batch[j]] = source;
+			changed_ = true;
+		}
+		files.clearContents();
+	}
+
+	// forget the deleted sources
+	set<string> seen (sources.begin(), sources.end());
+	for (auto it = sources_.begin(); complete && it != sources_.end(); ) {
+		if (seen.find(it->first) == seen.end()) {
+			it = sources_.erase(it);
+			changed_ = true;
+		}
+		else {
+			++it;
+		}
+	}
+
+	consumers_.clear();
+	for (auto it = sources_.begin(); it != sources_.end(); ++it) {
+		for (size_t i=0; i<it->second.includes.size(); ++i) {
+			consumers_[it->second.includes[i]].insert(it->first);
+		}
+	}
+}
+
+
+
+vector<string> IncludeIndex::consumers(const string& generatedName) const
+{
+	auto found = consumers_.find(generatedName);
+	if (found == consumers_.end()) {
+		return vector<string>();
+	}
+	return vector<string>(found->second.begin(), found->second.end());
+}
+
+
+
+vector<string> IncludeIndex::parseIncludes(const string& contents)
+{
+	vector<string> res;
+
+	size_t pos = 0;
+	while ((pos = contents.find('#', pos)) != string::npos) {
+		size_t i = pos + 1;
+		pos = i;
+
+		// only at the start of a line, after spaces
+		size_t bol = contents.rfind('\n', i-1);
+		bol = (bol == string::npos) ? 0 : bol+1;
+		if (contents.find_first_not_of(" \t", bol) != i-1) continue;
+
+		i = contents.find_first_not_of(" \t", i);
+		if (i == string::npos || contents.compare(i, 7, "include") != 0) continue;
+		i = contents.find_first_not_of(" \t", i+7);
+		if (i == string::npos) continue;
+
+		char close;
+		if (contents[i] == '"') close = '"';
+		else if (contents[i] == '<') close = '>';
+		else continue;
+
+		size_t end = contents.find_first_of(string(1, close) + "\n", i+1);
+		if (end == string::npos || contents[end] != close) continue;
+
+		string name = contents.substr(i+1, end-i-1);
+		size_t sep = name.find_last_of("/\\");
+		if (sep != string::npos) name = name.substr(sep+1);
+		if (name.size() > 0) res.push_back(name);
+		pos = end;
+	}
+
+	return res;
+}
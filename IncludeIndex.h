@@ -0,0 +1,75 @@
+/*
+	Copyright (c) 2013, Remi Thebault
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+		* Redistributions of source code must retain the above copyright
+		  notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above copyright
+		  notice, this list of conditions and the following disclaimer in the
+		  documentation and/or other materials provided with the distribution.
+		* Neither the name of the <organization> nor the
+		  names of its contributors may be used to endorse or promote products
+		  derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+	DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "FileCache.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+
+
+// Which sources include which generated files.
+// The index is kept between runs in a file: a source is read again only
+// when its modification time or size changed. It keeps every include, as
+// the files generated depend on the tools configured for the run.
+class IncludeIndex {
+public:
+
+	IncludeIndex() : changed_(false) {}
+
+	// a missing or invalid index file gives an empty index
+	void load(const std::string& path);
+	// does nothing if the index did not change since it was loaded
+	bool save(const std::string& path);
+
+	static bool isSource(const std::string& filename);
+
+	// updates the index for these sources, and forgets the other ones if
+	// they are all the sources
+	void update(const std::vector<std::string>& sources, FileCache& files,
+	            bool complete = true);
+
+	// the sources including the generated file name
+	std::vector<std::string> consumers(const std::string& generatedName) const;
+
+	// included file names of a source, without directory
+	static std::vector<std::string> parseIncludes(const std::string& contents);
+
+private:
+
+	struct Source {
+		unsigned long long mtime;
+		unsigned long long size;
+		std::vector<std::string> includes;
+	};
+
+	std::map<std::string, Source> sources_;
+	std::map<std::string, std::set<std::string> > consumers_;
+	bool changed_;
+};
@@ -0,0 +1,248 @@
+/*
+	Copyright (c) 2013, Remi Thebault
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+		* Redistributions of source code must retain the above copyright
+		  notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above copyright
+		  notice, this list of conditions and the following disclaimer in the
+		  documentation and/or other materials provided with the distribution.
+		* Neither the name of the <organization> nor the
+		  names of its contributors may be used to endorse or promote products
+		  derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+	DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "PrefixHeader.h"
+#include "FileCache.h"
+#include "FileUtils.h"
+#include "StringUtils.h"
+
+#include <fstream>
+#include <sstream>
+
+
+using namespace std;
+
+
+
+namespace {
+
+	const char *prefixStateHeader = "qtgentools-prefix 1";
+
+}
+
+
+
+void PrefixHeader::load(const string& path)
+{
+	name_.clear();
+	outputs_.clear();
+	changed_ = false;
+
+	ifstream in (path);
+	string line;
+	if (!getline(in, line) || line != prefixStateHeader || !getline(in, name_)) {
+		name_.clear();
+		return;
+	}
+
+	// output [\t header]...
+	while (getline(in, line)) {
+		vector<string> fields;
+		su::split(line, '\t', back_inserter(fields));
+		if (fields.empty() || fields[0].empty()) {
+			name_.clear();
+			outputs_.clear();
+			return;
+		}
+		outputs_[fields[0]].assign(fields.begin() + 1, fields.end());
+	}
+}
+
+
+
+bool PrefixHeader::save(const string& path)
+{
+	if (!changed_) {
+		return true;
+	}
+
+	if (outputs_.empty()) {
+		fu::rm(path);
+		changed_ = false;
+		return true;
+	}
+
+	ostringstream buf;
+	buf << prefixStateHeader << '\n' << name_ << '\n';
+	for (auto it = outputs_.begin(); it != outputs_.end(); ++it) {
+		buf << it->first;
+		for (size_t i=0; i<it->second.size(); ++i) {
+			buf << '\t' << it->second[i];
+		}
+		buf << '\n';
+	}
+
+	ofstream out (path, ios::binary | ios::trunc);
+	out << buf.str();
+	if (!out) {
+		return false;
+	}
+	changed_ = false;
+	return true;
+}
+
+
+
+void PrefixHeader::reset(const string& name)
+{
+	name_ = name;
+	outputs_.clear();
+	changed_ = true;
+}
+
+
+
+bool PrefixHeader::has(const string& output) const
+{
+	return outputs_.find(output) != outputs_.end();
+}
+
+
+
+void PrefixHeader::add(const string& output, const vector<string>& headers)
+{
+	auto found = outputs_.find(output);
+	if (found != outputs_.end() && found->second == headers) {
+		return;
+	}
+	outputs_[output] = headers;
+	changed_ = true;
+}
+
+
+
+void PrefixHeader::remove(const string& output)
+{
+	if (outputs_.erase(output) > 0) {
+		changed_ = true;
+	}
+}
+
+
+
+void PrefixHeader::retain(const set<string>& outputs)
+{
+	for (auto it = outputs_.begin(); it != outputs_.end(); ) {
+		if (outputs.find(it->first) == outputs.end()) {
+			it = outputs_.erase(it);
+			changed_ = true;
+		}
+		else {
+			++it;
+		}
+	}
+}
+
+
+
+void PrefixHeader::merge(const vector<PrefixHeader>& parts)
+{
+	map<string, vector<string> > outputs;
+	for (size_t i=0; i<parts.size(); ++i) {
+		outputs.insert(parts[i].outputs_.begin(), parts[i].outputs_.end());
+	}
+	if (outputs != outputs_) {
+		outputs_.swap(outputs);
+		changed_ = true;
+	}
+}
+
+
+
+string PrefixHeader::contents() const
+{
+	set<string> headers;
+	for (auto it = outputs_.begin(); it != outputs_.end(); ++it) {
+		headers.insert(it->second.begin(), it->second.end());
+	}
+
+	ostringstream buf;
+	buf << "// Generated by QtGenTools, do not edit.\n"
+	    << "// Headers of the moc and rcc outputs of this directory, which include\n"
+	    << "// this file first: it can be precompiled once for all of them.\n"
+	    << "#pragma once\n\n";
+	for (auto it = headers.begin(); it != headers.end(); ++it) {
+		buf << "#include <" << *it << ">\n";
+	}
+	return buf.str();
+}
+
+
+
+bool PrefixHeader::write(const string& path, bool& written) const
+{
+	string header = contents();
+	string current;
+	written = false;
+	if (FileCache::readSync(path, current) && current == header) {
+		return true;
+	}
+
+	// a changed header has the build precompile it again
+	ofstream out (path, ios::binary | ios::trunc);
+	out << header;
+	if (!out) {
+		return false;
+	}
+	written = true;
+	return true;
+}
+
+
+
+vector<string> PrefixHeader::parseIncludes(const string& contents)
+{
+	vector<string> res;
+	int depth = 0;
+
+	istringstream in (contents);
+	string line;
+	while (getline(in, line)) {
+		size_t i = line.find_first_not_of(" \t");
+		if (i == string::npos || line[i] != '#') continue;
+		i = line.find_first_not_of(" \t", i+1);
+		if (i == string::npos) continue;
+
+		size_t end = line.find_first_not_of("abcdefghijklmnopqrstuvwxyz", i);
+		string directive = line.substr(i, end - i);
+		if (directive == "if" || directive == "ifdef" || directive == "ifndef") {
+			++depth;
+		}
+		else if (directive == "endif") {
+			--depth;
+		}
+		else if (directive == "include" && depth == 0) {
+			// conditional includes could not compile outside of their block
+			i = line.find_first_not_of(" \t", end);
+			if (i == string::npos || line[i] != '<') continue;
+			end = line.find('>', i);
+			if (end == string::npos || end == i+1) continue;
+			res.push_back(line.substr(i+1, end-i-1));
+		}
+	}
+
+	return res;
+}
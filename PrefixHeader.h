@@ -0,0 +1,82 @@
+/*
+	Copyright (c) 2013, Remi Thebault
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+		* Redistributions of source code must retain the above copyright
+		  notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above copyright
+		  notice, this list of conditions and the following disclaimer in the
+		  documentation and/or other materials provided with the distribution.
+		* Neither the name of the <organization> nor the
+		  names of its contributors may be used to endorse or promote products
+		  derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+	DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+
+
+// Header included first by the moc and rcc outputs of an output directory,
+// including in turn the system and Qt headers these outputs include, so
+// that a build can precompile it once for all of them.
+// The headers of each output are kept between runs in a file, only the
+// outputs generated again are read.
+class PrefixHeader {
+public:
+
+	PrefixHeader() : changed_(false) {}
+
+	// a missing or invalid file gives no output
+	void load(const std::string& path);
+	// does nothing if nothing changed since loaded, removes the file if
+	// there is no output left
+	bool save(const std::string& path);
+
+	// name of the header the recorded outputs include, in their directory
+	const std::string& name() const {
+		return name_;
+	}
+	// forgets the outputs, they include another header
+	void reset(const std::string& name);
+
+	// true if the output (file name without directory) includes the header
+	bool has(const std::string& output) const;
+	// the output includes the header and these headers
+	void add(const std::string& output, const std::vector<std::string>& headers);
+	void remove(const std::string& output);
+	// forgets the outputs that are not given
+	void retain(const std::set<std::string>& outputs);
+	// the outputs of these headers of the same name, the union of the
+	// output directories of shards
+	void merge(const std::vector<PrefixHeader>& parts);
+
+	// header contents, the headers of the outputs in a stable order
+	std::string contents() const;
+	// writes the header if its contents changed, written tells if it did
+	bool write(const std::string& path, bool& written) const;
+
+	// headers included with angle brackets out of conditional blocks
+	static std::vector<std::string> parseIncludes(const std::string& contents);
+
+private:
+
+	std::string name_;
+	std::map<std::string, std::vector<std::string> > outputs_;
+	bool changed_;
+};
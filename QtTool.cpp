@@ -33,6 +33,7 @@
 #else
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #endif
 
 #include <algorithm>
@@ -48,125 +49,145 @@ using namespace std;
 
 
 
-bool QtTool::needsToRun(const std::string& inFile, const std::string& outFile)
+FileCache::Info QtTool::fileInfo(const std::string& path)
 {
-	if (!fu::isFile(inFile)) {
-		return false;
+	if (files_) {
+		return files_->stat(path);
 	}
-	if (!fu::isFile(outFile)) {
-		return true;
+	return FileCache::statSync(path);
+}
+
+
+
+bool QtTool::readFile(const std::string& path, std::string& contents)
+{
+	if (files_) {
+		return files_->read(path, contents);
 	}
-#ifdef _WIN32
-	HANDLE hInFile = CreateFile(inFile.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
-	                            OPEN_EXISTING, 0, NULL);
-	HANDLE hOutFile = CreateFile(outFile.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
-	                             OPEN_EXISTING, 0, NULL);
+	return FileCache::readSync(path, contents);
+}
+
+
 
-	if(hInFile == INVALID_HANDLE_VALUE) {
+bool QtTool::needsToRun(const std::string& inFile, const std::string& outFile,
+                        StaleReason& reason)
+{
+	FileCache::Info in = fileInfo(inFile);
+	if (!in.isFile) {
 		return false;
 	}
-	if(hOutFile == INVALID_HANDLE_VALUE) {
+	FileCache::Info out = fileInfo(outFile);
+	if (!out.isFile) {
+		reason.rule = "missing output";
+		reason.file = outFile;
 		return true;
 	}
+	return isNewer(inFile, outFile, "newer input", NULL, reason);
+}
 
-	FILETIME lstInMod, lstOutMod;
-	GetFileTime(hInFile, NULL, NULL, &lstInMod);
-	GetFileTime(hOutFile, NULL, NULL, &lstOutMod);
 
-	CloseHandle(hInFile);
-	CloseHandle(hOutFile);
 
-	return CompareFileTime(&lstInMod, &lstOutMod) == 1;
-#else
-	struct stat stIn;
-	struct stat stOut;
-	stat(inFile.c_str(), &stIn);
-	stat(outFile.c_str(), &stOut);
-	return stIn.st_mtime > stOut.st_mtime;
-#endif
+bool QtTool::isNewer(const string& file, const string& outFile,
+                     const char *rule, const char *missingRule, StaleReason& reason)
+{
+	FileCache::Info info = fileInfo(file);
+	FileCache::Info out = fileInfo(outFile);
+	if (!info.isFile) {
+		if (!missingRule) {
+			return false;
+		}
+		rule = missingRule;
+	}
+	else if (info.mtime <= out.mtime) {
+		return false;
+	}
+
+	reason.rule = rule;
+	reason.file = file;
+	reason.fileMtime = info.mtime;
+	reason.outMtime = out.mtime;
+	reason.clockSkew = info.mtime > FileCache::now();
+	return true;
 }
 
 
 
+void QtTool::getOutFilenames (const string&, const string& inFilename,
+                              vector<string>& outFilenames)
+{
+	outFilenames.push_back(getOutFilename(inFilename));
+}
 
 
-bool QtTool::runIfNeeded(const std::string& inFile, const std::string& outFile)
-{
-	if (needsToRun(inFile, outFile)) {
 
-		ostringstream cmd;
-		cmd << exePath_;
-		if (cmdOpts_.size() > 0) {
-			cmd << " " << cmdOpts_;
+bool QtTool::isCandidate(const string& inFile)
+{
+	for (size_t i=0; i<extensions_.size(); ++i) {
+		if (su::endsWith(inFile, extensions_[i])) {
+			return true;
 		}
-		cmd << " -o " << outFile << " " << inFile;
+	}
+	return false;
+}
 
-#ifdef _WIN32
-		const size_t bufSize = 512;
-		char buf [bufSize];
-
-		STARTUPINFO si;
-		PROCESS_INFORMATION pi;
-
-		ZeroMemory(&pi, sizeof(pi));
-		ZeroMemory(&si, sizeof(si));
-		si.cb = sizeof(si);
-		si.hStdError = GetStdHandle(STD_ERROR_HANDLE);
-		si.hStdOutput = GetStdHandle(STD_OUTPUT_HANDLE);
-		si.hStdInput = NULL;
-		si.dwFlags |= STARTF_USESTDHANDLES;
-
-		string cmdOpts = cmd.str();
-		for(size_t i=0; i<cmdOpts.size(); ++i) {
-			buf[i] = cmdOpts[i];
-			if (i == bufSize-1) break;
-		}
-		size_t i = min(size_t(bufSize-1), cmdOpts.size());
-		buf[i] = '\0';
-
-		// Start the child process.
-		if( !CreateProcess(
-		            NULL,			// module name
-		            buf,	        // Command line
-		            NULL,           // Process handle not inheritable
-		            NULL,           // Thread handle not inheritable
-		            TRUE,           // Set handle inheritance to TRUE
-		            0,              // No creation flags
-		            NULL,           // Use parent's environment block
-		            NULL,           // Use parent's starting directory
-		            &si,            // Pointer to STARTUPINFO structure
-		            &pi )           // Pointer to PROCESS_INFORMATION structure
-		  ) {
-			cerr << "CreateProcess err " << GetLastError() << "\n";
-			throw runtime_error("cannot start process");
-		}
-		WaitForSingleObject(pi.hProcess, INFINITE);
 
-		if (!CloseHandle(pi.hProcess)) {
-			cerr << "close handle process\n";
-		}
-		if (!CloseHandle(pi.hThread)) {
-			cerr << "close handle thread\n";
-		}
 
-#else
+bool QtTool::isTextOutput(const string& outFile) const
+{
+	return QtMocTool::isSource(outFile) || su::endsWith(outFile, string(".moc")) ||
+	       su::endsWith(outFile, string(".h")) || su::endsWith(outFile, string(".hpp")) ||
+	       su::endsWith(outFile, string(".hxx"));
+}
 
-		FILE *handle = popen(cmd.str().c_str(), "r");
 
-		if (handle == NULL) {
-			throw runtime_error("cannot start process");
-		}
 
-		char buf[64];
-		size_t readn;
-		while ((readn = fread(buf, 1, sizeof(buf), handle)) > 0) {
-			fwrite(buf, 1, readn, stdout);
-		}
+string QtTool::getOutFilename (const string& inFilename)
+{
+	string base;
+	string ext;
+	tie(base, ext) = fu::splitExt(inFilename);
 
-		pclose(handle);
+	string outFilename = outPattern_;
+	return su::replace(outFilename, string("@BASE@"), base);
+}
 
-#endif
 
+
+string QtTool::commandLine(const string& inFile, const string& outFile)
+{
+	ostringstream cmd;
+	cmd << exePath_;
+	if (cmdOpts_.size() > 0) {
+		cmd << " " << cmdOpts_;
+	}
+	cmd << " -o " << toolPath(outFile) << " " << toolPath(inFile);
+	return cmd.str();
+}
+
+
+
+string QtTool::toolPath(const string& path) const
+{
+	if (workDir_.empty()) {
+		return path;
+	}
+	return fu::relativePath(path, workDir_);
+}
+
+
+
+int QtTool::run(const string& inFile, const string& outFile)
+{
+	return runCmd(commandLine(inFile, outFile));
+}
+
+
+
+bool QtTool::runIfNeeded(const std::string& inFile, const std::string& outFile,
+                         int& exitStatus, StaleReason& reason)
+{
+	if (needsToRun(inFile, outFile, reason)) {
+		exitStatus = run(inFile, outFile);
 		return true;
 	}
 	return false;
@@ -174,6 +195,105 @@ bool QtTool::runIfNeeded(const std::string& inFile, const std::string& outFile)
 
 
 
+int QtTool::runCmd(const std::string& cmd)
+{
+#ifdef _WIN32
+	const size_t bufSize = 512;
+	char buf [bufSize];
+
+	STARTUPINFO si;
+	PROCESS_INFORMATION pi;
+
+	ZeroMemory(&pi, sizeof(pi));
+	ZeroMemory(&si, sizeof(si));
+	si.cb = sizeof(si);
+	si.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+	si.hStdOutput = GetStdHandle(STD_OUTPUT_HANDLE);
+	si.hStdInput = NULL;
+	si.dwFlags |= STARTF_USESTDHANDLES;
+
+	for(size_t i=0; i<cmd.size(); ++i) {
+		buf[i] = cmd[i];
+		if (i == bufSize-1) break;
+	}
+	size_t i = min(size_t(bufSize-1), cmd.size());
+	buf[i] = '\0';
+
+	// Start the child process.
+	if( !CreateProcess(
+	            NULL,			// module name
+	            buf,	        // Command line
+	            NULL,           // Process handle not inheritable
+	            NULL,           // Thread handle not inheritable
+	            TRUE,           // Set handle inheritance to TRUE
+	            0,              // No creation flags
+	            NULL,           // Use parent's environment block
+	            workDir_.empty() ? NULL : workDir_.c_str(), // starting directory
+	            &si,            // Pointer to STARTUPINFO structure
+	            &pi )           // Pointer to PROCESS_INFORMATION structure
+	  ) {
+		cerr << "CreateProcess err " << GetLastError() << "\n";
+		throw runtime_error("cannot start process");
+	}
+	WaitForSingleObject(pi.hProcess, INFINITE);
+
+	DWORD exitCode = 0;
+	GetExitCodeProcess(pi.hProcess, &exitCode);
+
+	if (!CloseHandle(pi.hProcess)) {
+		cerr << "close handle process\n";
+	}
+	if (!CloseHandle(pi.hThread)) {
+		cerr << "close handle thread\n";
+	}
+
+	return int(exitCode);
+
+#else
+
+	string shellCmd = cmd;
+	if (workDir_.size() > 0) {
+		shellCmd = "cd \"" + workDir_ + "\" && " + cmd;
+	}
+	FILE *handle = popen(shellCmd.c_str(), "r");
+
+	if (handle == NULL) {
+		throw runtime_error("cannot start process");
+	}
+
+	char buf[64];
+	size_t readn;
+	while ((readn = fread(buf, 1, sizeof(buf), handle)) > 0) {
+		fwrite(buf, 1, readn, stdout);
+	}
+
+	int status = pclose(handle);
+	if (status == -1) {
+		return -1;
+	}
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+
+#endif
+}
+
+
+
+
+QtMocTool::QtMocTool()
+{
+	extensions_.push_back(".h");
+	extensions_.push_back(".hpp");
+	extensions_.push_back(".hh");
+	extensions_.push_back(".hxx");
+	extensions_.push_back(".cpp");
+	extensions_.push_back(".cc");
+	extensions_.push_back(".cxx");
+	extensions_.push_back(".c++");
+	outPattern_ = "mo_@BASE@.cc";
+	depFile_ = false;
+}
+
+
 
 string QtMocTool::exePath(const string& qtBinPath)
 {
@@ -188,82 +308,292 @@ string QtMocTool::exePath(const string& qtBinPath)
 
 bool QtMocTool::isFileInput(const string& inFile)
 {
-	if (!su::endsWith(inFile, string(".h")) &&
-	        !su::endsWith(inFile, string(".hpp")) &&
-	        !su::endsWith(inFile, string(".hh")) &&
-	        !su::endsWith(inFile, string(".hxx"))) {
+	if (!isCandidate(inFile)) {
 		return false;
 	}
 
-	ifstream in (inFile);
-	if (!in) return false;
+	string contents;
+	if (!readFile(inFile, contents)) return false;
 
-	string line;
-	bool found = false;
-	const string q_object = "Q_OBJECT";
-	while(getline(in, line)) {
-		if(line.find(q_object) != string::npos) {
-			found = true;
-			break;
+	if (contents.find("Q_OBJECT") == string::npos) {
+		return false;
+	}
+	if (!isSource(inFile)) {
+		return true;
+	}
+
+	// a source must include its moc output, or it would not be compiled
+	string base;
+	string ext;
+	tie(base, ext) = fu::splitExt(inFile.substr(fu::parentDir(inFile).size()));
+	string included = "\"" + base + ".moc\"";
+
+	size_t pos = 0;
+	while ((pos = contents.find(included, pos)) != string::npos) {
+		size_t bol = contents.rfind('\n', pos);
+		bol = (bol == string::npos) ? 0 : bol+1;
+		string line = contents.substr(bol, pos - bol);
+		su::trim(line);
+		if (line.size() > 0 && line[0] == '#' && line.find("include") != string::npos) {
+			return true;
 		}
+		pos += included.size();
 	}
-	in.close();
-	return found;
+	return false;
 }
 
 
 
-std::string QtMocTool::getOutFilename (const string& inFileName)
+void QtMocTool::getOutFilenames (const string& inFile, const string& inFilename,
+                                 vector<string>& outFilenames)
 {
-	string base;
-	string ext;
-	tie(base, ext) = fu::splitExt(inFileName);
-
-	ostringstream oss;
-	oss << "mo_" << base << ".cc";
-	return oss.str();
+	if (isSource(inFilename)) {
+		string base;
+		string ext;
+		tie(base, ext) = fu::splitExt(inFilename);
+		outFilenames.push_back(base + ".moc");
+	}
+	else {
+		QtTool::getOutFilenames(inFile, inFilename, outFilenames);
+	}
 }
 
 
 
+bool QtMocTool::isSource(const string& filename)
+{
+	return su::endsWith(filename, string(".cpp")) || su::endsWith(filename, string(".cc")) ||
+	       su::endsWith(filename, string(".cxx")) || su::endsWith(filename, string(".c++"));
+}
+
 
 
-string QtUicTool::exePath(const string& qtBinPath)
+bool QtMocTool::supportsDepFile()
 {
+	call_once(depFileProbe_, [this]() {
 #ifdef _WIN32
-	return qtBinPath + "uic.exe";
+		FILE *handle = _popen((exePath_ + " --help").c_str(), "r");
 #else
-	return qtBinPath + "uic";
-#endif // _WIN32
+		FILE *handle = popen((exePath_ + " --help 2>&1").c_str(), "r");
+#endif
+		if (handle) {
+			string help;
+			char buf[256];
+			size_t readn;
+			while ((readn = fread(buf, 1, sizeof(buf), handle)) > 0) {
+				help.append(buf, readn);
+			}
+#ifdef _WIN32
+			_pclose(handle);
+#else
+			pclose(handle);
+#endif
+			depFile_ = help.find("--output-dep-file") != string::npos &&
+			           help.find("--dep-file-path") != string::npos;
+		}
+	});
+	return depFile_;
 }
 
 
 
-bool QtUicTool::isFileInput(const string& inFile)
+vector<string> QtMocTool::pluginFiles(const string& inFile)
 {
-	if (!su::endsWith(inFile, string(".ui"))) {
-		return false;
+	vector<string> res;
+	string baseDir = fu::parentDir(inFile);
+
+	string contents;
+	readFile(inFile, contents);
+
+	size_t pos = 0;
+	while ((pos = contents.find("Q_PLUGIN_METADATA", pos)) != string::npos) {
+		pos += 17;
+		size_t end = contents.find(')', pos);
+		if (end == string::npos) break;
+
+		// FILE "name.json" anywhere between the parentheses
+		size_t file = contents.find("FILE", pos);
+		if (file != string::npos && file < end) {
+			size_t open = contents.find('"', file + 4);
+			size_t close = (open == string::npos) ? open : contents.find('"', open + 1);
+			if (close != string::npos && close < end) {
+				string fn = contents.substr(open + 1, close - open - 1);
+				if (fn.size() > 0) {
+					res.push_back(baseDir + fn);
+				}
+			}
+		}
+		pos = end;
 	}
-	return true;
+
+	return res;
 }
 
 
 
-string QtUicTool::getOutFilename (const string& inFileName)
+string QtMocTool::depFilename(const string& outFile)
 {
-	string base;
-	string ext;
-	tie(base, ext) = fu::splitExt(inFileName);
+	string dir = fu::parentDir(outFile);
+	return dir + "." + outFile.substr(dir.size()) + ".d";
+}
+
+
+
+vector<string> QtMocTool::parseDepFile(const string& contents)
+{
+	vector<string> res;
+
+	// skip the target, the separator is a colon followed by a space
+	size_t pos = contents.find(": ");
+	if (pos == string::npos) {
+		return res;
+	}
+
+	string dep;
+	for (size_t i=pos+2; i<contents.size(); ++i) {
+		char c = contents[i];
+		if (c == '\\' && i+1 < contents.size()) {
+			char next = contents[i+1];
+			if (next == ' ' || next == '#') {
+				dep.push_back(next);
+				++i;
+				continue;
+			}
+			if (next == '\n' || next == '\r') {
+				continue;
+			}
+		}
+		else if (c == '$' && i+1 < contents.size() && contents[i+1] == '$') {
+			dep.push_back('$');
+			++i;
+			continue;
+		}
+		if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+			if (dep.size() > 0) res.push_back(dep);
+			dep.clear();
+			continue;
+		}
+		dep.push_back(c);
+	}
+	if (dep.size() > 0) res.push_back(dep);
+
+	return res;
+}
+
+
+
+bool QtMocTool::needsToRun(const string& inFile, const string& outFile,
+                           StaleReason& reason)
+{
+	if (QtTool::needsToRun(inFile, outFile, reason)) {
+		return true;
+	}
+
+	// outputs of previous versions have no dependency file
+	vector<string> deps;
+	string contents;
+	if (readFile(depFilename(outFile), contents)) {
+		deps = parseDepFile(contents);
+	}
+	else {
+		deps = pluginFiles(inFile);
+	}
+
+	for (size_t i=0; i<deps.size(); ++i) {
+		// written relative to the work directory of the run
+		if (workDir_.size() > 0 && !fu::isAbsolute(deps[i])) {
+			deps[i] = workDir_ + deps[i];
+		}
+		if (isNewer(deps[i], outFile, "newer dependency", "missing dependency", reason)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+
+
+int QtMocTool::run(const string& inFile, const string& outFile)
+{
+	int exitStatus;
+	string depFile = depFilename(outFile);
+	ostringstream cmd;
+	cmd << exePath_;
+	if (cmdOpts_.size() > 0) {
+		cmd << " " << cmdOpts_;
+	}
+	// included as is, next to the output
+	if (includesPrefixHeader(inFile)) {
+		cmd << " -b " << prefixHeader_;
+	}
+
+	if (supportsDepFile()) {
+		cmd << " --output-dep-file --dep-file-path " << toolPath(depFile);
+		cmd << " -o " << toolPath(outFile) << " " << toolPath(inFile);
+		exitStatus = runCmd(cmd.str());
+	}
+	else {
+		cmd << " -o " << toolPath(outFile) << " " << toolPath(inFile);
+		exitStatus = runCmd(cmd.str());
+		if (exitStatus == 0) {
+			// the same format as moc, with the only dependencies that can
+			// change without the header
+			vector<string> files = pluginFiles(inFile);
+			files.insert(files.begin(), inFile);
+			ofstream dep (depFile, ios::binary | ios::trunc);
+			dep << toolPath(outFile) << ":";
+			for (size_t i=0; i<files.size(); ++i) {
+				string fn = toolPath(files[i]);
+				su::replace(fn, string(" "), string("\\ "));
+				dep << (i == 0 ? " " : " \\\n  ") << fn;
+			}
+			dep << '\n';
+		}
+	}
+
+	if (files_) {
+		files_->invalidate(depFile);
+	}
+	return exitStatus;
+}
+
 
-	ostringstream oss;
-	oss << "ui_" << base << ".h";
-	return oss.str();
+
+bool QtMocTool::includesPrefixHeader(const string& inFile)
+{
+	return prefixHeader_.size() > 0 && !isSource(inFile);
 }
 
 
 
+QtUicTool::QtUicTool()
+{
+	extensions_.push_back(".ui");
+	outPattern_ = "ui_@BASE@.h";
+}
+
+
+
+string QtUicTool::exePath(const string& qtBinPath)
+{
+#ifdef _WIN32
+	return qtBinPath + "uic.exe";
+#else
+	return qtBinPath + "uic";
+#endif // _WIN32
+}
+
 
 
+QtRccTool::QtRccTool()
+	: mode_(Embed)
+	, autoThreshold_(8*1024*1024)
+	, fingerprint_(false)
+	, shared_(false)
+{
+	extensions_.push_back(".qrc");
+	outPattern_ = "rc_@BASE@.cc";
+}
 
 
 
@@ -278,58 +608,429 @@ string QtRccTool::exePath(const string& qtBinPath)
 
 
 
-bool QtRccTool::isFileInput(const string& inFile)
+void QtRccTool::getOutFilenames (const string& inFile, const string& inFilename,
+                                 vector<string>& outFilenames)
 {
-	if (!su::endsWith(inFile, string(".qrc"))) {
-		return false;
+	string base;
+	string ext;
+	tie(base, ext) = fu::splitExt(inFilename);
+
+	switch (modeOf(inFile)) {
+	case Binary:
+		outFilenames.push_back(base + ".rcc");
+		break;
+	case BigResources: {
+		string outFilename = getOutFilename(inFilename);
+		outFilenames.push_back(outFilename);
+		tie(base, ext) = fu::splitExt(outFilename);
+		outFilenames.push_back(base + ".pass2");
+		break;
+	}
+	default:
+		outFilenames.push_back(getOutFilename(inFilename));
+		break;
 	}
-	return true;
 }
 
 
 
-string QtRccTool::getOutFilename (const string& inFileName)
+bool QtRccTool::parseMode(const string& str, Mode& mode)
 {
-	string base;
-	string ext;
-	tie(base, ext) = fu::splitExt(inFileName);
-
-	ostringstream oss;
-	oss << "rc_" << base << ".cc";
-	return oss.str();
+	if (str == "embed") mode = Embed;
+	else if (str == "binary") mode = Binary;
+	else if (str == "big") mode = BigResources;
+	else if (str == "auto") mode = Auto;
+	else return false;
+	return true;
 }
 
 
 
-
-bool QtRccTool::needsToRun(const std::string& inFile, const std::string& outFile)
+QtRccTool::Mode QtRccTool::modeOf(const string& inFile)
 {
-	if (QtTool::needsToRun(inFile, outFile)) {
-		return true;
+	{
+		lock_guard<mutex> lock (resolvedModesMutex_);
+		auto resolved = resolvedModes_.find(inFile);
+		if (resolved != resolvedModes_.end()) {
+			return resolved->second;
+		}
 	}
-	bool run = false;
 
+	string filename = inFile.substr(fu::parentDir(inFile).size());
+	auto found = qrcModes_.find(filename);
+	Mode mode = (found != qrcModes_.end()) ? found->second : mode_;
+
+	if (mode == Auto) {
+		unsigned long long size = 0;
+		vector<string> res = resources(inFile);
+		for (size_t i=0; i<res.size(); ++i) {
+			size += fileInfo(res[i]).size;
+		}
+		mode = (size > autoThreshold_) ? BigResources : Embed;
+	}
+
+	lock_guard<mutex> lock (resolvedModesMutex_);
+	resolvedModes_[inFile] = mode;
+	return mode;
+}
+
+
+
+vector<string> QtRccTool::resources(const string& inFile)
+{
+	vector<string> res;
 	string baseDir = fu::parentDir(inFile);
 
-	ifstream in (inFile);
+	string contents;
+	readFile(inFile, contents);
+
+	istringstream in (contents);
 	string line;
 	while(getline(in, line)) {
-		size_t pos = line.find("<file>");
+		// <file> or <file alias="...">
+		size_t pos = line.find("<file");
+		if (pos == string::npos) continue;
+		pos = line.find('>', pos);
+		if (pos == string::npos || line[pos-1] == '/') continue;
+		line = line.substr(pos + 1);
+		pos = line.find("</file>");
 		if (pos != string::npos) {
-			line = line.substr(pos + 6);
-			pos = line.find("</file>");
-			if (pos != string::npos) {
-				string fn = line.substr(0, pos);
-				if (fn.size() > 0) {
-					string resFile = baseDir + fn;
-					run = QtTool::needsToRun(resFile, outFile);
-					if (run) break;
-				}
+			string fn = line.substr(0, pos);
+			su::trim(fn);
+			if (fn.size() > 0) {
+				res.push_back(baseDir + fn);
+			}
+		}
+	}
+
+	return res;
+}
+
+
+
+string QtRccTool::fingerprintFilename(const string& outFile)
+{
+	string dir = fu::parentDir(outFile);
+	return dir + "." + outFile.substr(dir.size()) + ".fp";
+}
+
+
+
+string QtRccTool::sharedQrcFilename(const string& outFile)
+{
+	string dir = fu::parentDir(outFile);
+	return dir + "." + outFile.substr(dir.size()) + ".qrc";
+}
+
+
+
+string QtRccTool::rccInput(const string& inFile, const string& outFile)
+{
+	string sharedQrc = sharedQrcFilename(outFile);
+	if (shared_ && fileInfo(sharedQrc).isFile) {
+		return sharedQrc;
+	}
+	return inFile;
+}
+
+
+
+vector<string> QtRccTool::fingerprintFiles(const string& inFile)
+{
+	vector<string> files (1, inFile);
+	vector<string> res = resources(inFile);
+	for (size_t i=0; i<res.size(); ++i) {
+		if (!fileInfo(res[i]).isDir) {
+			files.push_back(res[i]);
+			continue;
+		}
+		// rcc embeds the files of a directory recursively
+		vector<string> dirFiles;
+		auto collect = [&dirFiles](const string& root, const string& filename, bool) {
+			dirFiles.push_back(root + filename);
+		};
+		fu::walk(res[i], collect);
+		sort(dirFiles.begin(), dirFiles.end());
+		files.insert(files.end(), dirFiles.begin(), dirFiles.end());
+	}
+	return files;
+}
+
+
+
+bool QtRccTool::fingerprintChanged(const string& inFile, const string& outFile,
+                                   StaleReason& reason)
+{
+	string path = fingerprintFilename(outFile);
+	ResourceFingerprint previous;
+	if (!previous.load(path)) {
+		// first run with fingerprints: modification times decide, and the
+		// fingerprint is computed when rcc runs
+		if (isNewer(inFile, outFile, "newer input", NULL, reason)) {
+			return true;
+		}
+		vector<string> res = resources(inFile);
+		for (size_t i=0; i<res.size(); ++i) {
+			if (isNewer(res[i], outFile, "newer resource", NULL, reason)) {
+				return true;
+			}
+		}
+	}
+
+	ResourceFingerprint current;
+	current.compute(fingerprintFiles(inFile), previous, files_);
+
+	if (previous.empty() || current.root() == previous.root()) {
+		// touched files keep their hash with their new modification time
+		if (!current.sameStats(previous)) {
+			current.save(path);
+		}
+		return false;
+	}
+
+	switch (current.change(previous, reason.file)) {
+	case ResourceFingerprint::Added:
+		reason.rule = "added resource";
+		break;
+	case ResourceFingerprint::Removed:
+		reason.rule = "removed resource";
+		break;
+	case ResourceFingerprint::Reordered:
+		reason.rule = "reordered resources";
+		reason.file = inFile;
+		break;
+	default:
+		reason.rule = "changed resource";
+		break;
+	}
+	reason.oldFingerprint = previous.root();
+	reason.newFingerprint = current.root();
+	lock_guard<mutex> lock (fingerprintsMutex_);
+	fingerprints_[outFile] = current;
+	return true;
+}
+
+
+
+bool QtRccTool::needsToRun(const std::string& inFile, const std::string& outFile,
+                           StaleReason& reason)
+{
+	// generated from the copy without the shared resources
+	string sharedQrc = sharedQrcFilename(outFile);
+	if (!shared_ && fileInfo(sharedQrc).isFile && fileInfo(inFile).isFile) {
+		reason.rule = "resources no longer shared";
+		reason.file = sharedQrc;
+		return true;
+	}
+	string qrcFile = rccInput(inFile, outFile);
+
+	if (fingerprint_) {
+		// the contents of the qrc file are part of the fingerprint
+		if (!fileInfo(inFile).isFile) {
+			return false;
+		}
+		if (!fileInfo(outFile).isFile) {
+			reason.rule = "missing output";
+			reason.file = outFile;
+			return true;
+		}
+	}
+	else if (QtTool::needsToRun(qrcFile, outFile, reason)) {
+		return true;
+	}
+
+	// the pass 2 arguments file goes together with the pass 1 source,
+	// its presence tells which of the two flavors rc_<name>.cc is
+	if (modeOf(inFile) != Binary) {
+		string base;
+		string ext;
+		tie(base, ext) = fu::splitExt(outFile);
+		if (fileInfo(base + ".pass2").isFile != (modeOf(inFile) == BigResources)) {
+			reason.rule = "rcc mode changed";
+			reason.file = base + ".pass2";
+			return true;
+		}
+	}
+
+	if (fingerprint_) {
+		return fingerprintChanged(qrcFile, outFile, reason);
+	}
+
+	vector<string> res = resources(qrcFile);
+	for (size_t i=0; i<res.size(); ++i) {
+		if (isNewer(res[i], outFile, "newer resource", NULL, reason)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+
+
+int QtRccTool::run(const string& inFile, const string& outFile)
+{
+	if (!shared_) {
+		fu::rm(sharedQrcFilename(outFile));
+	}
+	string qrcFile = rccInput(inFile, outFile);
+
+	int exitStatus;
+	ostringstream cmd;
+	cmd << exePath_;
+	if (cmdOpts_.size() > 0) {
+		cmd << " " << cmdOpts_;
+	}
+
+	switch (modeOf(inFile)) {
+	case Binary:
+		cmd << " --binary -o " << toolPath(outFile) << " " << toolPath(qrcFile);
+		exitStatus = runCmd(cmd.str());
+		break;
+
+	case BigResources: {
+		string prefix = cmd.str();
+		cmd << " --pass 1 -o " << toolPath(outFile) << " " << toolPath(qrcFile);
+		exitStatus = runCmd(cmd.str());
+		if (exitStatus != 0) {
+			break;
+		}
+
+		// The second pass patches the object file compiled from the pass 1
+		// source. The build system runs it after replacing @OBJ@.
+		string base;
+		string ext;
+		tie(base, ext) = fu::splitExt(outFile);
+		ofstream pass2 (base + ".pass2");
+		if (!pass2) {
+			throw runtime_error("cannot write " + base + ".pass2");
+		}
+		pass2 << prefix << " --pass 2 --temp @OBJ@ -o @OBJ@ " << toolPath(qrcFile) << '\n';
+		break;
+	}
+
+	default:
+		cmd << " -o " << toolPath(outFile) << " " << toolPath(qrcFile);
+		exitStatus = runCmd(cmd.str());
+		break;
+	}
+
+	// the fingerprint of the embedded contents, or none if unknown
+	string fingerprintFile = fingerprintFilename(outFile);
+	if (exitStatus == 0 && fingerprint_) {
+		ResourceFingerprint fingerprint;
+		{
+			lock_guard<mutex> lock (fingerprintsMutex_);
+			auto found = fingerprints_.find(outFile);
+			if (found != fingerprints_.end()) {
+				fingerprint = found->second;
+				fingerprints_.erase(found);
 			}
 		}
+		if (fingerprint.empty()) {
+			ResourceFingerprint previous;
+			previous.load(fingerprintFile);
+			fingerprint.compute(fingerprintFiles(qrcFile), previous, files_);
+		}
+		fingerprint.save(fingerprintFile);
+	}
+	else {
+		fu::rm(fingerprintFile);
+	}
+
+	if (exitStatus == 0 && includesPrefixHeader(inFile)) {
+		prependPrefixHeader(outFile);
 	}
-	in.close();
 
-	return run;
+	return exitStatus;
 }
 
+
+
+int QtRccTool::runUnit(const string& qrcFile, const string& outFile, const string& name)
+{
+	ostringstream cmd;
+	cmd << exePath_;
+	if (cmdOpts_.size() > 0) {
+		cmd << " " << cmdOpts_;
+	}
+	cmd << " --name " << name << " -o " << toolPath(outFile) << " " << toolPath(qrcFile);
+	int exitStatus = runCmd(cmd.str());
+	if (exitStatus == 0 && prefixHeader_.size() > 0) {
+		prependPrefixHeader(outFile);
+	}
+	return exitStatus;
+}
+
+
+
+void QtRccTool::prependPrefixHeader(const string& outFile)
+{
+	string contents;
+	if (!FileCache::readSync(outFile, contents)) {
+		throw runtime_error("cannot read " + outFile);
+	}
+	ofstream out (outFile, ios::binary | ios::trunc);
+	out << "#include \"" << prefixHeader_ << "\"\n" << contents;
+	if (!out) {
+		throw runtime_error("cannot write " + outFile);
+	}
+}
+
+
+
+bool QtRccTool::includesPrefixHeader(const string& inFile)
+{
+	return prefixHeader_.size() > 0 && modeOf(inFile) != Binary;
+}
+
+
+
+bool QtRccTool::isTextOutput(const string& outFile) const
+{
+	return QtTool::isTextOutput(outFile) || su::endsWith(outFile, string(".pass2"));
+}
+
+
+
+
+QtGenericTool::QtGenericTool(const string& name, const string& exe,
+                             const vector<string>& extensions,
+                             const string& outPattern, const string& args)
+	: name_(name)
+	, exe_(exe)
+	, args_(args)
+{
+	extensions_ = extensions;
+	outPattern_ = outPattern;
+}
+
+
+
+string QtGenericTool::exePath(const string& qtBinPath)
+{
+	if (exe_.find(fu::pathSep) != string::npos) {
+		return exe_;
+	}
+#ifdef _WIN32
+	return qtBinPath + exe_ + ".exe";
+#else
+	return qtBinPath + exe_;
+#endif // _WIN32
+}
+
+
+
+string QtGenericTool::commandLine(const string& inFile, const string& outFile)
+{
+	string args = args_;
+	su::replace(args, string("@IN@"), toolPath(inFile));
+	su::replace(args, string("@OUT@"), toolPath(outFile));
+
+	ostringstream cmd;
+	cmd << exePath_;
+	if (cmdOpts_.size() > 0) {
+		cmd << " " << cmdOpts_;
+	}
+	cmd << " " << args;
+	return cmd.str();
+}
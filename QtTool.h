@@ -26,13 +26,36 @@
 */
 #pragma once
 
+#include "FileCache.h"
+#include "ResourceFingerprint.h"
 
 #include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+
+
+// Why a tool had to run: the rule that fired and the file it fired on.
+struct StaleReason {
+	StaleReason() : fileMtime(0), outMtime(0), clockSkew(false) {}
+
+	std::string rule;		// empty if the outputs are up to date
+	std::string file;
+	unsigned long long fileMtime;	// in the unit of FileCache::Info::mtime
+	unsigned long long outMtime;
+	bool clockSkew;			// file modified in the future
+	// root hashes of the ResourceFingerprint, for changed resources
+	std::string oldFingerprint;
+	std::string newFingerprint;
+};
+
 
 
 class QtTool {
 public:
 
+	QtTool() : files_(NULL) {}
+
 	void init(const std::string& qtBinPath) {
 		exePath_ = exePath(qtBinPath);
 		if (exePath_.find(' ') != std::string::npos) {
@@ -41,23 +64,113 @@ public:
 		}
 	}
 
+	virtual ~QtTool() {}
+
+	virtual const char *name() const =0;
 	virtual std::string exePath(const std::string& qtBinPath) =0;
-	virtual bool isFileInput(const std::string& inFile) =0;
-	virtual std::string getOutFilename (const std::string& inFilename) =0;
 
-	virtual bool needsToRun(const std::string& inFile, const std::string& outFile);
+	// checks the file name only, against the extensions
+	virtual bool isCandidate(const std::string& inFile);
+	// true if isFileInput or needsToRun read the input contents
+	virtual bool readsInput() const {
+		return false;
+	}
+	virtual bool isFileInput(const std::string& inFile) {
+		return isCandidate(inFile);
+	}
+	// applies the output pattern
+	virtual std::string getOutFilename (const std::string& inFilename);
+
+	// first output is the primary one, given to runIfNeeded
+	virtual void getOutFilenames (const std::string& inFile, const std::string& inFilename,
+	                              std::vector<std::string>& outFilenames);
 
-	virtual bool runIfNeeded(const std::string& inFile, const std::string& outFile);
+	// reason tells why when true is returned
+	virtual bool needsToRun(const std::string& inFile, const std::string& outFile,
+	                        StaleReason& reason);
 
+	// Runs the tool without checking the outputs, returns its exit status.
+	// Can be called from several threads at once.
+	virtual int run(const std::string& inFile, const std::string& outFile);
+
+	// returns true if the tool was run, exitStatus is then its exit status
+	bool runIfNeeded(const std::string& inFile, const std::string& outFile,
+	                 int& exitStatus, StaleReason& reason);
+
+	const std::string& cmdOpts() const {
+		return cmdOpts_;
+	}
 	void setCmdOpts(const std::string& cmdOpts) {
 		cmdOpts_ = cmdOpts;
 	}
 
+	// input file extensions, with the dot
+	const std::vector<std::string>& extensions() const {
+		return extensions_;
+	}
+	void setExtensions(const std::vector<std::string>& extensions) {
+		extensions_ = extensions;
+	}
+
+	// output file name, where @BASE@ stands for the input file base name
+	const std::string& outPattern() const {
+		return outPattern_;
+	}
+	void setOutPattern(const std::string& outPattern) {
+		outPattern_ = outPattern;
+	}
+
+	// files are stat'ed and read through the cache if it is set
+	void setFileCache(FileCache *files) {
+		files_ = files;
+	}
+
+	// Runs the tool from this directory, with paths relative to it,
+	// from the current directory if empty.
+	void setWorkDir(const std::string& dir) {
+		workDir_ = dir;
+	}
+
+	// Header of the output directory that the C++ source outputs include
+	// first (see PrefixHeader), none if empty.
+	void setPrefixHeader(const std::string& name) {
+		prefixHeader_ = name;
+	}
+	// true if the output of inFile includes the prefix header
+	virtual bool includesPrefixHeader(const std::string&) {
+		return false;
+	}
+	// true if paths can be replaced in an output: the C++ sources and
+	// headers, not the binary ones (.rcc, .qm...)
+	virtual bool isTextOutput(const std::string& outFile) const;
+
 
 protected:
 
+	// command line running the tool on inFile
+	virtual std::string commandLine(const std::string& inFile, const std::string& outFile);
+
+	// returns the exit status
+	int runCmd(const std::string& cmd);
+
+	// path given to the tool, relative to the work directory if set
+	std::string toolPath(const std::string& path) const;
+
+	FileCache::Info fileInfo(const std::string& path);
+
+	// Fills reason and returns true if file is missing (when missingRule is
+	// set) or newer than outFile.
+	bool isNewer(const std::string& file, const std::string& outFile,
+	             const char *rule, const char *missingRule, StaleReason& reason);
+	bool readFile(const std::string& path, std::string& contents);
+
 	std::string exePath_;
 	std::string cmdOpts_;
+	std::vector<std::string> extensions_;
+	std::string outPattern_;
+	std::string workDir_;
+	std::string prefixHeader_;
+	FileCache *files_;
 };
 
 
@@ -65,10 +178,46 @@ protected:
 class QtMocTool : public QtTool {
 public:
 
+	QtMocTool();
+
+	virtual const char *name() const override {
+		return "moc";
+	}
 	virtual std::string exePath(const std::string& qtBinPath) override;
+	virtual bool readsInput() const override {
+		return true;
+	}
+	// headers with Q_OBJECT, and sources with Q_OBJECT that include the
+	// moc output (#include "<base>.moc")
 	virtual bool isFileInput(const std::string& inFile) override;
-	virtual std::string getOutFilename (const std::string& inFilename) override;
+	// <base>.moc for sources, the output pattern for headers
+	virtual void getOutFilenames (const std::string& inFile, const std::string& inFilename,
+	                              std::vector<std::string>& outFilenames) override;
+	// also checks the dependencies recorded at the previous run
+	virtual bool needsToRun(const std::string& inFile, const std::string& outFile,
+	                        StaleReason& reason) override;
+	virtual int run(const std::string& inFile, const std::string& outFile) override;
+	// through moc -b, not for the sources: their output is not compiled alone
+	virtual bool includesPrefixHeader(const std::string& inFile) override;
+
+	// true if moc can write a dependency file (--output-dep-file, Qt 5.15)
+	bool supportsDepFile();
+
+	// files referenced by Q_PLUGIN_METADATA(... FILE "...") in a header
+	std::vector<std::string> pluginFiles(const std::string& inFile);
+
+	// Dependencies of an output are kept in a make style file next to it,
+	// hidden so that it is never taken for a stale output.
+	static std::string depFilename(const std::string& outFile);
+	static std::vector<std::string> parseDepFile(const std::string& contents);
 
+	// true for the C++ source extensions (.cpp, .cc, .cxx, .c++)
+	static bool isSource(const std::string& filename);
+
+private:
+
+	std::once_flag depFileProbe_;
+	bool depFile_;
 };
 
 
@@ -76,9 +225,12 @@ public:
 class QtUicTool : public QtTool {
 public:
 
+	QtUicTool();
+
+	virtual const char *name() const override {
+		return "uic";
+	}
 	virtual std::string exePath(const std::string& qtBinPath) override;
-	virtual bool isFileInput(const std::string& inFile) override;
-	virtual std::string getOutFilename (const std::string& inFilename) override;
 
 };
 
@@ -87,9 +239,121 @@ public:
 class QtRccTool : public QtTool {
 public:
 
+	enum Mode {
+		Embed,			// rc_<name>.cc with all resource bytes as C arrays
+		Binary,			// external <name>.rcc through rcc --binary
+		BigResources,	// rc_<name>.cc from rcc --pass 1, and rc_<name>.pass2
+		Auto			// Embed or BigResources depending on resources size
+	};
+
+	QtRccTool();
+
+	virtual const char *name() const override {
+		return "rcc";
+	}
 	virtual std::string exePath(const std::string& qtBinPath) override;
-	virtual bool isFileInput(const std::string& inFile) override;
-	virtual std::string getOutFilename (const std::string& inFilename) override;
-	virtual bool needsToRun(const std::string& inFile, const std::string& outFile) override;
+	virtual bool readsInput() const override {
+		return true;
+	}
+	virtual void getOutFilenames (const std::string& inFile, const std::string& inFilename,
+	                              std::vector<std::string>& outFilenames) override;
+	virtual bool needsToRun(const std::string& inFile, const std::string& outFile,
+	                        StaleReason& reason) override;
+	virtual int run(const std::string& inFile, const std::string& outFile) override;
+	// Generates the unit of the shared resources (see SharedResources) from
+	// its qrc file, with the options of the other outputs. The unit is
+	// initialized at startup or by Q_INIT_RESOURCE(name).
+	int runUnit(const std::string& qrcFile, const std::string& outFile,
+	            const std::string& name);
+	// added to the rcc output, but not in Binary mode
+	virtual bool includesPrefixHeader(const std::string& inFile) override;
+	// also the command line of the second pass in BigResources mode
+	virtual bool isTextOutput(const std::string& outFile) const override;
+
+	static bool parseMode(const std::string& str, Mode& mode);
+
+	void setMode(Mode mode) {
+		mode_ = mode;
+	}
+	void setMode(const std::string& qrcFilename, Mode mode) {
+		qrcModes_[qrcFilename] = mode;
+	}
+	void setAutoThreshold(unsigned long long bytes) {
+		autoThreshold_ = bytes;
+	}
+	// Decide from the contents of the qrc file and of its resources, kept
+	// as a ResourceFingerprint next to the output, instead of their
+	// modification times.
+	void setFingerprint(bool enabled) {
+		fingerprint_ = enabled;
+	}
+	// Give rcc the copy of a qrc file without the resources shared with
+	// other qrc files, when there is one next to the output (see
+	// SharedResources). The outputs generated from such a copy are
+	// generated again once the option is removed.
+	void setSharedResources(bool enabled) {
+		shared_ = enabled;
+	}
+
+	// resolved mode of a qrc file (never Auto)
+	Mode modeOf(const std::string& inFile);
+
+	// paths of the files referenced by a qrc file
+	std::vector<std::string> resources(const std::string& inFile);
+
+	// fingerprint of the resources, hidden next to the output
+	static std::string fingerprintFilename(const std::string& outFile);
+	// qrc file without the shared resources, hidden next to the output
+	static std::string sharedQrcFilename(const std::string& outFile);
+
+private:
+
+	// the qrc file given to rcc
+	std::string rccInput(const std::string& inFile, const std::string& outFile);
+	// rcc has no option to include a file
+	void prependPrefixHeader(const std::string& outFile);
+
+	// the qrc file then its resources, directories replaced by their files
+	std::vector<std::string> fingerprintFiles(const std::string& inFile);
+	bool fingerprintChanged(const std::string& inFile, const std::string& outFile,
+	                        StaleReason& reason);
+
+	Mode mode_;
+	unsigned long long autoThreshold_;
+	std::map<std::string, Mode> qrcModes_;
+	std::map<std::string, Mode> resolvedModes_;
+	std::mutex resolvedModesMutex_;
+	bool fingerprint_;
+	bool shared_;
+	// computed by needsToRun, saved once run succeeds, per output
+	std::map<std::string, ResourceFingerprint> fingerprints_;
+	std::mutex fingerprintsMutex_;
+};
+
+
+
+// A tool entirely described by its configuration.
+// In the arguments, @IN@ and @OUT@ stand for the input and output files.
+class QtGenericTool : public QtTool {
+public:
+
+	QtGenericTool(const std::string& name, const std::string& exe,
+	              const std::vector<std::string>& extensions,
+	              const std::string& outPattern, const std::string& args);
+
+	virtual const char *name() const override {
+		return name_.c_str();
+	}
+	// exe is looked up in the Qt bin directory unless it is a path
+	virtual std::string exePath(const std::string& qtBinPath) override;
+
+protected:
+
+	virtual std::string commandLine(const std::string& inFile, const std::string& outFile) override;
+
+private:
 
+	std::string name_;
+	std::string exe_;
+	std::string args_;
 };
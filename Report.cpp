@@ -0,0 +1,277 @@
+/*
+	Copyright (c) 2013, Remi Thebault
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+		* Redistributions of source code must retain the above copyright
+		  notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above copyright
+		  notice, this list of conditions and the following disclaimer in the
+		  documentation and/or other materials provided with the distribution.
+		* Neither the name of the <organization> nor the
+		  names of its contributors may be used to endorse or promote products
+		  derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+	DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "Report.h"
+
+#include <sstream>
+#include <cstdio>
+
+
+using namespace std;
+
+
+
+namespace {
+
+	void writeString(ostream& out, const string& str)
+	{
+		out << '"';
+		for (size_t i=0; i<str.size(); ++i) {
+			unsigned char c = str[i];
+			switch (c) {
+			case '"': out << "\\\""; break;
+			case '\\': out << "\\\\"; break;
+			case '\n': out << "\\n"; break;
+			case '\r': out << "\\r"; break;
+			case '\t': out << "\\t"; break;
+			default:
+				if (c < 0x20) {
+					char buf[8];
+					snprintf(buf, sizeof(buf), "\\u%04x", c);
+					out << buf;
+				}
+				else {
+					out << c;
+				}
+			}
+		}
+		out << '"';
+	}
+
+
+	void writeRecord(ostream& out, const FileRecord& record, bool explain)
+	{
+		out << "{\"type\":\"file\",";
+		if (record.toolchain.size() > 0) {
+			out << "\"toolchain\":";
+			writeString(out, record.toolchain);
+			out << ',';
+		}
+		out << "\"tool\":";
+		writeString(out, record.tool);
+		out << ",\"input\":";
+		writeString(out, record.input);
+		out << ",\"output\":";
+		writeString(out, record.output);
+		out << ",\"action\":";
+		writeString(out, record.action);
+		out << ",\"reason\":";
+		writeString(out, record.reason);
+		out << ",\"duration_ms\":" << record.durationMs;
+		out << ",\"exit_status\":" << record.exitStatus;
+		if (explain && record.stale.rule.size() > 0) {
+			const StaleReason& stale = record.stale;
+			out << ",\"stale\":{\"rule\":";
+			writeString(out, stale.rule);
+			out << ",\"file\":";
+			writeString(out, stale.file);
+			if (stale.fileMtime > 0) {
+				out << ",\"file_mtime\":" << stale.fileMtime;
+				out << ",\"output_mtime\":" << stale.outMtime;
+				out << ",\"clock_skew\":" << (stale.clockSkew ? "true" : "false");
+			}
+			if (stale.newFingerprint != stale.oldFingerprint) {
+				out << ",\"old_fingerprint\":";
+				writeString(out, stale.oldFingerprint);
+				out << ",\"new_fingerprint\":";
+				writeString(out, stale.newFingerprint);
+			}
+			out << '}';
+		}
+		if (record.affected.size() > 0) {
+			out << ",\"affected\":[";
+			for (size_t i=0; i<record.affected.size(); ++i) {
+				if (i > 0) out << ',';
+				writeString(out, record.affected[i]);
+			}
+			out << ']';
+		}
+		out << '}';
+	}
+
+
+	void writeSummary(ostream& out, const DriverResult& result)
+	{
+		out << "{\"type\":\"summary\",\"inD\":";
+		writeString(out, result.inD);
+		out << ",\"outD\":";
+		writeString(out, result.outD);
+		out << ",\"untouched\":" << result.untouched.size();
+		out << ",\"generated\":" << result.generated.size();
+		out << ",\"updated\":" << result.updated.size();
+		out << ",\"deleted\":" << result.deleted.size();
+		out << ",\"errors\":" << result.errors.size();
+		out << ",\"duration_ms\":" << result.durationMs << '}';
+	}
+
+
+	// one line per tool run
+	void writeExplanations(ostream& out, const DriverResult& result)
+	{
+		for (size_t i=0; i<result.records.size(); ++i) {
+			const FileRecord& record = result.records[i];
+			const StaleReason& stale = record.stale;
+			if (stale.rule.empty()) continue;
+			// the outputs of a same run follow each other
+			if (i > 0 && result.records[i-1].input == record.input &&
+			        result.records[i-1].tool == record.tool &&
+			        result.records[i-1].toolchain == record.toolchain) continue;
+
+			out << "explain: ";
+			if (record.toolchain.size() > 0) {
+				out << record.toolchain << ' ';
+			}
+			out << record.tool << ' ' << record.input << ": " << stale.rule;
+			if (stale.file != record.input) {
+				out << ' ' << stale.file;
+			}
+			if (stale.fileMtime > 0) {
+				out << " (mtime " << stale.fileMtime << " > output mtime " << stale.outMtime << ')';
+			}
+			if (stale.clockSkew) {
+				out << ", clock skew: modified in the future";
+			}
+			if (stale.newFingerprint != stale.oldFingerprint) {
+				out << " (fingerprint " << stale.oldFingerprint << " -> " << stale.newFingerprint << ')';
+			}
+			out << '\n';
+		}
+	}
+
+
+	void writeText(ostream& out, const DriverResult& result, bool explain)
+	{
+		string sep (79, '-');
+		out << sep << '\n';
+		out << ' ' << result.inD << '\n';
+		out << sep << '\n';
+
+		if (result.generated.size() > 0) {
+			for (size_t i=0; i<result.generated.size(); ++i) {
+				out << "generated: " << result.generated[i] << '\n';
+			}
+			out << sep << '\n';
+		}
+
+		if (result.updated.size() > 0) {
+			for (size_t i=0; i<result.updated.size(); ++i) {
+				out << "updated: " << result.updated[i] << '\n';
+			}
+			out << sep << '\n';
+		}
+
+		bool affected = false;
+		for (size_t i=0; i<result.records.size(); ++i) {
+			const FileRecord& record = result.records[i];
+			for (size_t j=0; j<record.affected.size(); ++j) {
+				out << "affected: " << record.affected[j] << " (" << record.output << ")\n";
+				affected = true;
+			}
+		}
+		if (affected) {
+			out << sep << '\n';
+		}
+
+		if (explain) {
+			ostringstream explanations;
+			writeExplanations(explanations, result);
+			if (explanations.tellp() > 0) {
+				out << explanations.str() << sep << '\n';
+			}
+		}
+
+		if (result.deleted.size() > 0) {
+			for (size_t i=0; i<result.deleted.size(); ++i) {
+				out << "deleted: " << result.deleted[i] << '\n';
+			}
+			out << sep << '\n';
+		}
+
+		out << result.untouched.size() << " file(s) were already up-to-date\n";
+		out << result.generated.size() << " file(s) have been generated\n";
+		out << result.updated.size() << " file(s) have been updated\n";
+		out << result.deleted.size() << " file(s) have been deleted\n";
+
+		if (result.errors.size() > 0) {
+			out << sep << '\n';
+			out << "error occured when processing the following file(s):\n";
+			for (size_t i=0; i<result.errors.size(); ++i) {
+				out << result.errors[i] << '\n';
+			}
+		}
+	}
+
+}
+
+
+
+bool parseReportFormat(const string& str, ReportFormat& format)
+{
+	if (str == "text") format = TextReport;
+	else if (str == "json") format = JsonReport;
+	else if (str == "ndjson") format = NdjsonReport;
+	else return false;
+	return true;
+}
+
+
+
+void writeReport(const DriverResult& result, ReportFormat format, ostream& out,
+                 bool explain)
+{
+	ostringstream buf;
+
+	switch (format) {
+	case JsonReport:
+		buf << "{\"files\":[";
+		for (size_t i=0; i<result.records.size(); ++i) {
+			if (i > 0) buf << ',';
+			buf << '\n';
+			writeRecord(buf, result.records[i], explain);
+		}
+		buf << "\n],\n\"summary\":";
+		writeSummary(buf, result);
+		buf << "}\n";
+		break;
+
+	case NdjsonReport:
+		for (size_t i=0; i<result.records.size(); ++i) {
+			writeRecord(buf, result.records[i], explain);
+			buf << '\n';
+		}
+		writeSummary(buf, result);
+		buf << '\n';
+		break;
+
+	default:
+		writeText(buf, result, explain);
+		break;
+	}
+
+	const string& str = buf.str();
+	out.write(str.data(), str.size());
+	out.flush();
+}
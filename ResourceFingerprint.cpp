@@ -0,0 +1,340 @@
+/*
+	Copyright (c) 2013, Remi Thebault
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+		* Redistributions of source code must retain the above copyright
+		  notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above copyright
+		  notice, this list of conditions and the following disclaimer in the
+		  documentation and/or other materials provided with the distribution.
+		* Neither the name of the <organization> nor the
+		  names of its contributors may be used to endorse or promote products
+		  derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+	DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "ResourceFingerprint.h"
+#include "Sha256.h"
+#include "StringUtils.h"
+#include "FileUtils.h"
+
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <map>
+#include <thread>
+#include <algorithm>
+
+
+using namespace std;
+
+
+
+namespace {
+
+	const char *fingerprintHeader = "qtgentools-fingerprint 2";
+
+	const unsigned long long chunkSize = 1024*1024;
+	// files of at least this number of chunks are hashed in parallel
+	const size_t parallelChunks = 8;
+
+#ifdef _WIN32
+	const unsigned long long second = 10000000ULL;	// FILETIME unit
+#else
+	const unsigned long long second = 1;
+#endif
+
+	// hashes the chunks first to last (excluded) of the file
+	bool hashChunks(const string& path, unsigned long long size, size_t first, size_t last,
+	                vector<string>& hashes)
+	{
+		ifstream in (path, ios::binary);
+		if (!in || !in.seekg(first * chunkSize)) {
+			return false;
+		}
+		vector<char> buf (size_t(min(chunkSize, size)));
+		for (size_t i=first; i<last; ++i) {
+			size_t len = size_t(min(chunkSize, size - i*chunkSize));
+			if (!in.read(&buf[0], len)) {
+				return false;
+			}
+			Sha256 sha;
+			sha.update(&buf[0], len);
+			hashes[i] = sha.hexDigest();
+		}
+		return true;
+	}
+
+}
+
+
+
+bool ResourceFingerprint::load(const string& path)
+{
+	leaves_.clear();
+	root_.clear();
+
+	ifstream in (path);
+	string line;
+	if (!getline(in, line) || line != fingerprintHeader || !getline(in, line)) {
+		return false;
+	}
+	string root = line;
+
+	// hash \t size \t mtime \t path, the hash of a missing file is -
+	while (getline(in, line)) {
+		vector<string> fields;
+		su::split(line, '\t', back_inserter(fields));
+		if (fields.size() != 4) {
+			leaves_.clear();
+			return false;
+		}
+		Leaf leaf;
+		leaf.hash = (fields[0] == "-") ? string() : fields[0];
+		leaf.size = strtoull(fields[1].c_str(), NULL, 10);
+		leaf.mtime = strtoull(fields[2].c_str(), NULL, 10);
+		leaf.path = fields[3];
+		leaves_.push_back(leaf);
+	}
+	root_ = root;
+	return true;
+}
+
+
+
+bool ResourceFingerprint::save(const string& path) const
+{
+	ostringstream buf;
+	buf << fingerprintHeader << '\n' << root_ << '\n';
+	for (size_t i=0; i<leaves_.size(); ++i) {
+		const Leaf& leaf = leaves_[i];
+		buf << (leaf.hash.empty() ? string("-") : leaf.hash) << '\t' << leaf.size << '\t'
+		    << leaf.mtime << '\t' << leaf.path << '\n';
+	}
+
+	ofstream out (path, ios::binary | ios::trunc);
+	out << buf.str();
+	return bool(out);
+}
+
+
+
+void ResourceFingerprint::compute(const vector<string>& files, const ResourceFingerprint& previous,
+                                  FileCache *cache)
+{
+	map<string, const Leaf *> known;
+	for (size_t i=0; i<previous.leaves_.size(); ++i) {
+		known[previous.leaves_[i].path] = &previous.leaves_[i];
+	}
+
+	unsigned long long now = FileCache::now();
+	leaves_.clear();
+
+	for (size_t i=0; i<files.size(); ++i) {
+		FileCache::Info info = cache ? cache->stat(files[i]) : FileCache::statSync(files[i]);
+
+		Leaf leaf;
+		leaf.path = files[i];
+		leaf.size = info.isFile ? info.size : 0;
+		leaf.mtime = info.isFile ? info.mtime : 0;
+
+		if (info.isFile) {
+			auto found = known.find(files[i]);
+			if (found != known.end() && found->second->mtime != 0 &&
+			        found->second->mtime == leaf.mtime && found->second->size == leaf.size) {
+				leaf.hash = found->second->hash;
+			}
+			else if (!hashFile(files[i], leaf.size, leaf.hash)) {
+				leaf.hash.clear();
+				leaf.mtime = 0;
+			}
+			// a change in the same second would not change the time stamp
+			if (leaf.mtime + second >= now) {
+				leaf.mtime = 0;
+			}
+		}
+		leaves_.push_back(leaf);
+	}
+	root_ = rootHash();
+}
+
+
+
+map<string, string> ResourceFingerprint::dirHashes() const
+{
+	// entries of each directory: file names, and sub-directory names
+	// ending with a separator
+	map<string, map<string, string> > entries;
+	for (size_t i=0; i<leaves_.size(); ++i) {
+		string dir = fu::parentDir(leaves_[i].path);
+		entries[dir][leaves_[i].path.substr(dir.size())] = leaves_[i].hash.empty() ? "-" : leaves_[i].hash;
+	}
+
+	// deepest first: a directory sorts after its parent, which is hashed
+	// once all its sub-directories are
+	map<string, string> hashes;
+	while (!entries.empty()) {
+		auto last = --entries.end();
+		string dir = last->first;
+		Sha256 sha;
+		for (auto it = last->second.begin(); it != last->second.end(); ++it) {
+			sha.update(it->first);
+			sha.update("\t" + it->second + "\n");
+		}
+		string hash = sha.hexDigest();
+		entries.erase(last);
+		hashes[dir] = hash;
+
+		if (dir.empty()) {
+			continue;
+		}
+		// the roots of the file system (drives) are entries of the tree root
+		string parent = fu::parentDir(dir);
+		if (parent == dir || parent.empty()) {
+			entries[string()][dir] = hash;
+		}
+		else {
+			entries[parent][dir.substr(parent.size())] = hash;
+		}
+	}
+	return hashes;
+}
+
+
+
+string ResourceFingerprint::rootHash() const
+{
+	Sha256 order;
+	for (size_t i=0; i<leaves_.size(); ++i) {
+		order.update(leaves_[i].path + "\n");
+	}
+	map<string, string> dirs = dirHashes();
+	return Sha256::hash(dirs[string()] + "\t" + order.hexDigest() + "\n");
+}
+
+
+
+ResourceFingerprint::Change ResourceFingerprint::change(const ResourceFingerprint& other,
+                                                        string& file) const
+{
+	file.clear();
+	if (root_ == other.root_) {
+		return Unchanged;
+	}
+
+	// the files of the directories whose hashes are the same did not change
+	map<string, string> dirs = dirHashes();
+	map<string, string> otherDirs = other.dirHashes();
+	map<string, const Leaf *> otherLeaves;
+	for (size_t i=0; i<other.leaves_.size(); ++i) {
+		otherLeaves[other.leaves_[i].path] = &other.leaves_[i];
+	}
+
+	for (size_t i=0; i<leaves_.size(); ++i) {
+		string dir = fu::parentDir(leaves_[i].path);
+		auto otherDir = otherDirs.find(dir);
+		if (otherDir != otherDirs.end() && otherDir->second == dirs[dir]) {
+			continue;
+		}
+		auto found = otherLeaves.find(leaves_[i].path);
+		if (found == otherLeaves.end()) {
+			file = leaves_[i].path;
+			return Added;
+		}
+		if (found->second->hash != leaves_[i].hash) {
+			file = leaves_[i].path;
+			return Modified;
+		}
+	}
+
+	map<string, const Leaf *> leaves;
+	for (size_t i=0; i<leaves_.size(); ++i) {
+		leaves[leaves_[i].path] = &leaves_[i];
+	}
+	for (size_t i=0; i<other.leaves_.size(); ++i) {
+		if (leaves.find(other.leaves_[i].path) == leaves.end()) {
+			file = other.leaves_[i].path;
+			return Removed;
+		}
+	}
+	return Reordered;
+}
+
+
+
+
+bool ResourceFingerprint::sameStats(const ResourceFingerprint& other) const
+{
+	if (leaves_.size() != other.leaves_.size()) {
+		return false;
+	}
+	for (size_t i=0; i<leaves_.size(); ++i) {
+		const Leaf& a = leaves_[i];
+		const Leaf& b = other.leaves_[i];
+		if (a.path != b.path || a.size != b.size || a.mtime != b.mtime) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+
+bool ResourceFingerprint::hashFile(const string& path, unsigned long long size, string& hash)
+{
+	size_t chunks = size_t((size + chunkSize - 1) / chunkSize);
+	vector<string> hashes (chunks);
+
+	unsigned threads = 1;
+	if (chunks >= parallelChunks) {
+		threads = unsigned(min(chunks, size_t(max(1u, thread::hardware_concurrency()))));
+	}
+
+	if (threads <= 1) {
+		if (chunks > 0 && !hashChunks(path, size, 0, chunks, hashes)) {
+			return false;
+		}
+	}
+	else {
+		// contiguous ranges of chunks, each read through its own stream
+		size_t perThread = (chunks + threads - 1) / threads;
+		vector<char> ok (threads, 1);
+		vector<thread> workers;
+		for (unsigned t=0; t<threads; ++t) {
+			size_t first = t * perThread;
+			size_t last = min(chunks, first + perThread);
+			if (first >= last) break;
+			workers.push_back(thread([&, t, first, last]() {
+				ok[t] = hashChunks(path, size, first, last, hashes) ? 1 : 0;
+			}));
+		}
+		for (size_t t=0; t<workers.size(); ++t) {
+			workers[t].join();
+		}
+		if (find(ok.begin(), ok.end(), 0) != ok.end()) {
+			return false;
+		}
+	}
+
+	// the root of the chunk hashes
+	Sha256 sha;
+	ostringstream header;
+	header << size << '\n';
+	sha.update(header.str());
+	for (size_t i=0; i<chunks; ++i) {
+		sha.update(hashes[i]);
+	}
+	hash = sha.hexDigest();
+	return true;
+}
@@ -0,0 +1,100 @@
+/*
+	Copyright (c) 2013, Remi Thebault
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+		* Redistributions of source code must retain the above copyright
+		  notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above copyright
+		  notice, this list of conditions and the following disclaimer in the
+		  documentation and/or other materials provided with the distribution.
+		* Neither the name of the <organization> nor the
+		  names of its contributors may be used to endorse or promote products
+		  derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+	DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "FileCache.h"
+
+#include <string>
+#include <vector>
+#include <map>
+
+
+// Merkle fingerprint of the files embedded from a qrc file: the SHA-256 of
+// the contents of each file, the hash of each directory from the names and
+// hashes of its entries, and a root hash of the directories and of the
+// order of the files. Computing it again reads only the files whose size
+// or modification time changed, so that files touched but not modified
+// are not taken as changed. Large files are hashed by chunks in parallel.
+class ResourceFingerprint {
+public:
+
+	// how the files differ from those of another fingerprint
+	enum Change {
+		Unchanged,
+		Modified,		// the contents of a file
+		Added,			// a file the other fingerprint does not have
+		Removed,		// a file only the other fingerprint has
+		Reordered		// the same files and contents in another order
+	};
+
+	// false if the file is missing or invalid, the fingerprint is then empty
+	bool load(const std::string& path);
+	bool save(const std::string& path) const;
+
+	// Hashes the files, in this order. The hashes of previous are kept
+	// for the files of the same size and modification time. Files are
+	// stat'ed through the cache if not NULL.
+	void compute(const std::vector<std::string>& files, const ResourceFingerprint& previous,
+	             FileCache *cache);
+
+	// 64 hexadecimal digits, empty if nothing was computed or loaded
+	const std::string& root() const {
+		return root_;
+	}
+	bool empty() const {
+		return leaves_.empty();
+	}
+
+	// What changed since other, and the first file modified, added or
+	// removed. Only the directories whose hashes differ are looked into.
+	Change change(const ResourceFingerprint& other, std::string& file) const;
+	// true if the files have the same sizes and modification times
+	bool sameStats(const ResourceFingerprint& other) const;
+
+	// SHA-256 of the size and of the chunks of a file of this size, the
+	// chunks of large files are hashed in parallel. False if the file
+	// cannot be read.
+	static bool hashFile(const std::string& path, unsigned long long size, std::string& hash);
+
+private:
+
+	struct Leaf {
+		std::string path;
+		unsigned long long size;
+		unsigned long long mtime;	// 0 if the hash must be computed again
+		std::string hash;			// empty for a missing file
+	};
+
+	// hashes of the directories of the files and of their parents, by
+	// path; the key of the root of the tree is empty
+	std::map<std::string, std::string> dirHashes() const;
+	// root of the tree of dirHashes(), and of the order of the files
+	std::string rootHash() const;
+
+	std::vector<Leaf> leaves_;
+	std::string root_;
+};
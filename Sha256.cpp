@@ -0,0 +1,150 @@
+/*
+	Copyright (c) 2013, Remi Thebault
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+		* Redistributions of source code must retain the above copyright
+		  notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above copyright
+		  notice, this list of conditions and the following disclaimer in the
+		  documentation and/or other materials provided with the distribution.
+		* Neither the name of the <organization> nor the
+		  names of its contributors may be used to endorse or promote products
+		  derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+	DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "Sha256.h"
+
+#include <cstring>
+#include <algorithm>
+
+
+using namespace std;
+
+
+
+namespace {
+
+	const unsigned k[64] = {
+		0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+		0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+		0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+		0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+		0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+		0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+		0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+		0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+	};
+
+	inline unsigned rotr(unsigned x, unsigned n)
+	{
+		return (x >> n) | (x << (32 - n));
+	}
+
+}
+
+
+
+Sha256::Sha256()
+	: blockSize_(0), length_(0)
+{
+	const unsigned init[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+	memcpy(state_, init, sizeof(state_));
+}
+
+
+
+void Sha256::update(const char *data, size_t size)
+{
+	const unsigned char *bytes = reinterpret_cast<const unsigned char *>(data);
+	length_ += size;
+	while (size > 0) {
+		size_t n = min(size, sizeof(block_) - blockSize_);
+		memcpy(block_ + blockSize_, bytes, n);
+		blockSize_ += n;
+		bytes += n;
+		size -= n;
+		if (blockSize_ == sizeof(block_)) {
+			transform(block_);
+			blockSize_ = 0;
+		}
+	}
+}
+
+
+
+string Sha256::hexDigest()
+{
+	// a one bit, zeros, and the length in bits in the last 8 bytes
+	unsigned long long bits = length_ * 8;
+	const char one = char(0x80);
+	update(&one, 1);
+	const char zero = 0;
+	while (blockSize_ != 56) {
+		update(&zero, 1);
+	}
+	char length[8];
+	for (int i=0; i<8; ++i) {
+		length[i] = char((bits >> (56 - 8*i)) & 0xff);
+	}
+	update(length, 8);
+
+	static const char digits[] = "0123456789abcdef";
+	string hex;
+	for (int i=0; i<8; ++i) {
+		for (int shift=28; shift>=0; shift-=4) {
+			hex.push_back(digits[(state_[i] >> shift) & 0xf]);
+		}
+	}
+	return hex;
+}
+
+
+
+void Sha256::transform(const unsigned char *block)
+{
+	unsigned w[64];
+	for (int i=0; i<16; ++i) {
+		w[i] = (unsigned(block[4*i]) << 24) | (unsigned(block[4*i+1]) << 16) |
+		       (unsigned(block[4*i+2]) << 8) | block[4*i+3];
+	}
+	for (int i=16; i<64; ++i) {
+		unsigned s0 = rotr(w[i-15], 7) ^ rotr(w[i-15], 18) ^ (w[i-15] >> 3);
+		unsigned s1 = rotr(w[i-2], 17) ^ rotr(w[i-2], 19) ^ (w[i-2] >> 10);
+		w[i] = w[i-16] + s0 + w[i-7] + s1;
+	}
+
+	unsigned a = state_[0], b = state_[1], c = state_[2], d = state_[3];
+	unsigned e = state_[4], f = state_[5], g = state_[6], h = state_[7];
+	for (int i=0; i<64; ++i) {
+		unsigned s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+		unsigned ch = (e & f) ^ (~e & g);
+		unsigned t1 = h + s1 + ch + k[i] + w[i];
+		unsigned s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+		unsigned maj = (a & b) ^ (a & c) ^ (b & c);
+		unsigned t2 = s0 + maj;
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+	state_[0] += a; state_[1] += b; state_[2] += c; state_[3] += d;
+	state_[4] += e; state_[5] += f; state_[6] += g; state_[7] += h;
+}
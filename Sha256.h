@@ -0,0 +1,62 @@
+/*
+	Copyright (c) 2013, Remi Thebault
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+		* Redistributions of source code must retain the above copyright
+		  notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above copyright
+		  notice, this list of conditions and the following disclaimer in the
+		  documentation and/or other materials provided with the distribution.
+		* Neither the name of the <organization> nor the
+		  names of its contributors may be used to endorse or promote products
+		  derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+	DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include <string>
+
+
+// SHA-256 (FIPS 180-4) of a byte stream, for the content hashes that decide
+// whether a file changed: unlike a 64 bits hash, a collision is not to be
+// expected even across many runs and large resource sets.
+class Sha256 {
+public:
+
+	Sha256();
+
+	void update(const char *data, size_t size);
+	void update(const std::string& data) {
+		update(data.data(), data.size());
+	}
+
+	// 64 hexadecimal digits, the object cannot be updated anymore
+	std::string hexDigest();
+
+	static std::string hash(const std::string& data) {
+		Sha256 sha;
+		sha.update(data);
+		return sha.hexDigest();
+	}
+
+private:
+
+	void transform(const unsigned char *block);
+
+	unsigned state_[8];
+	unsigned char block_[64];
+	size_t blockSize_;
+	unsigned long long length_;		// in bytes
+};
@@ -0,0 +1,544 @@
+/*
+	Copyright (c) 2013, Remi Thebault
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+		* Redistributions of source code must retain the above copyright
+		  notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above copyright
+		  notice, this list of conditions and the following disclaimer in the
+		  documentation and/or other materials provided with the distribution.
+		* Neither the name of the <organization> nor the
+		  names of its contributors may be used to endorse or promote products
+		  derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+	DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "SharedResources.h"
+#include "ResourceFingerprint.h"
+#include "FileUtils.h"
+#include "StringUtils.h"
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+
+using namespace std;
+
+
+
+namespace {
+
+	const char *sharedStateHeader = "qtgentools-shared 2";
+	const char *signatureLine = "<!-- Signature: ";
+
+#ifdef _WIN32
+	const unsigned long long second = 10000000ULL;	// FILETIME unit
+#else
+	const unsigned long long second = 1;
+#endif
+
+	string unescape(string str)
+	{
+		su::replace(str, string("&lt;"), string("<"));
+		su::replace(str, string("&gt;"), string(">"));
+		su::replace(str, string("&quot;"), string("\""));
+		su::replace(str, string("&apos;"), string("'"));
+		su::replace(str, string("&amp;"), string("&"));
+		return str;
+	}
+
+	string escape(const string& str)
+	{
+		string res;
+		for (size_t i=0; i<str.size(); ++i) {
+			switch (str[i]) {
+			case '&': res += "&amp;"; break;
+			case '<': res += "&lt;"; break;
+			case '>': res += "&gt;"; break;
+			case '"': res += "&quot;"; break;
+			default: res.push_back(str[i]); break;
+			}
+		}
+		return res;
+	}
+
+	// name and value of the attributes of an element, values as written
+	vector<pair<string, string> > parseAttributes(const string& attributes)
+	{
+		vector<pair<string, string> > res;
+		size_t i = 0;
+		while ((i = attributes.find_first_not_of(" \t\r\n", i)) != string::npos) {
+			size_t eq = attributes.find('=', i);
+			if (eq == string::npos) break;
+			size_t open = attributes.find_first_of("\"'", eq);
+			if (open == string::npos) break;
+			size_t close = attributes.find(attributes[open], open + 1);
+			if (close == string::npos) break;
+			string name = attributes.substr(i, eq - i);
+			su::trim(name);
+			res.push_back(make_pair(name, attributes.substr(open + 1, close - open - 1)));
+			i = close + 1;
+		}
+		return res;
+	}
+
+	// without the empty, "." and ".." components, as rcc cleans the aliases
+	string cleanAlias(const string& alias)
+	{
+		vector<string> comps = fu::pathComponents(alias);
+		string res;
+		for (size_t i=0; i<comps.size(); ++i) {
+			if (res.empty() && comps[i] == "..") continue;
+			if (res.size() > 0) res.push_back('/');
+			res += comps[i];
+		}
+		return res;
+	}
+
+}
+
+
+
+bool SharedResources::parseQrc(const string& qrcFile, vector<Resource>& resources)
+{
+	string contents;
+	if (!FileCache::readSync(qrcFile, contents)) {
+		return false;
+	}
+	string baseDir = fu::parentDir(qrcFile);
+
+	string prefix = "/";
+	string lang;
+	size_t pos = 0;
+	while ((pos = contents.find('<', pos)) != string::npos) {
+		if (contents.compare(pos, 4, "<!--") == 0) {
+			pos = contents.find("-->", pos);
+			continue;
+		}
+		size_t end = contents.find('>', pos);
+		if (end == string::npos) {
+			break;
+		}
+		string tag = contents.substr(pos + 1, end - pos - 1);
+		pos = end + 1;
+
+		bool empty = tag.size() > 0 && tag.back() == '/';
+		if (empty) tag.pop_back();
+		size_t nameEnd = min(tag.size(), tag.find_first_of(" \t\r\n", 1));
+		string name = tag.substr(0, nameEnd);
+		vector<pair<string, string> > attributes = parseAttributes(tag.substr(nameEnd));
+
+		if (name == "qresource") {
+			prefix = "/";
+			lang.clear();
+			for (size_t i=0; i<attributes.size(); ++i) {
+				if (attributes[i].first == "prefix") prefix = unescape(attributes[i].second);
+				else if (attributes[i].first == "lang") lang = unescape(attributes[i].second);
+			}
+			if (prefix.empty() || prefix[0] != '/') prefix.insert(0, 1, '/');
+			if (prefix.back() != '/') prefix.push_back('/');
+			continue;
+		}
+		if (name != "file" || empty) {
+			continue;
+		}
+
+		end = contents.find("</file>", pos);
+		if (end == string::npos) {
+			break;
+		}
+		string path = unescape(contents.substr(pos, end - pos));
+		su::trim(path);
+		pos = end + 7;
+		if (path.empty()) {
+			continue;
+		}
+
+		Resource res;
+		res.prefix = prefix;
+		res.lang = lang;
+		string alias = path;
+		for (size_t i=0; i<attributes.size(); ++i) {
+			if (attributes[i].first == "alias") {
+				alias = unescape(attributes[i].second);
+				continue;
+			}
+			string value = attributes[i].second;
+			su::replace(value, string("\""), string("&quot;"));
+			res.attributes += " " + attributes[i].first + "=\"" + value + "\"";
+		}
+		res.alias = cleanAlias(alias);
+		res.file = fu::isAbsolute(path) ? path : baseDir + path;
+
+		if (!fu::isDir(res.file)) {
+			resources.push_back(res);
+			continue;
+		}
+
+		// rcc embeds the files of a directory recursively, under its alias
+		string dir = res.file;
+		if (dir.back() != fu::pathSep) dir.push_back(fu::pathSep);
+		vector<string> files;
+		auto collect = [&files](const string& root, const string& filename, bool) {
+			files.push_back(root + filename);
+		};
+		fu::walk(dir, collect);
+		sort(files.begin(), files.end());
+		for (size_t i=0; i<files.size(); ++i) {
+			Resource child = res;
+			child.file = files[i];
+			child.alias = cleanAlias(res.alias + "/" + files[i].substr(dir.size()));
+			resources.push_back(child);
+		}
+	}
+
+	return true;
+}
+
+
+
+void SharedResources::load(const string& path)
+{
+	qrcFiles_.clear();
+	resources_.clear();
+	hashes_.clear();
+	shared_.clear();
+	changed_ = false;
+
+	ifstream in (path);
+	string line;
+	if (!getline(in, line) || line != sharedStateHeader) {
+		return;
+	}
+
+	// qrc \t path, file \t hash \t size \t mtime \t path, or shared \t hash \t size
+	while (getline(in, line)) {
+		vector<string> fields;
+		su::split(line, '\t', back_inserter(fields));
+		if (fields.size() == 2 && fields[0] == "qrc") {
+			qrcFiles_.push_back(fields[1]);
+		}
+		else if (fields.size() == 3 && fields[0] == "shared") {
+			shared_.insert(Key(strtoull(fields[2].c_str(), NULL, 10), fields[1]));
+		}
+		else if (fields.size() == 5 && fields[0] == "file") {
+			Hash& hash = hashes_[fields[4]];
+			hash.hash = fields[1];
+			hash.size = strtoull(fields[2].c_str(), NULL, 10);
+			hash.mtime = strtoull(fields[3].c_str(), NULL, 10);
+		}
+		else {
+			qrcFiles_.clear();
+			hashes_.clear();
+			shared_.clear();
+			return;
+		}
+	}
+}
+
+
+
+bool SharedResources::save(const string& path)
+{
+	if (!changed_) {
+		return true;
+	}
+
+	ostringstream buf;
+	buf << sharedStateHeader << '\n';
+	for (size_t i=0; i<qrcFiles_.size(); ++i) {
+		buf << "qrc\t" << qrcFiles_[i] << '\n';
+	}
+	for (auto it = hashes_.begin(); it != hashes_.end(); ++it) {
+		buf << "file\t" << it->second.hash << '\t' << it->second.size << '\t'
+		    << it->second.mtime << '\t' << it->first << '\n';
+	}
+	for (auto it = shared_.begin(); it != shared_.end(); ++it) {
+		buf << "shared\t" << it->second << '\t' << it->first << '\n';
+	}
+
+	ofstream out (path, ios::binary | ios::trunc);
+	out << buf.str();
+	if (!out) {
+		return false;
+	}
+	changed_ = false;
+	return true;
+}
+
+
+
+void SharedResources::update(const vector<string>& qrcFiles, FileCache *cache)
+{
+	vector<string> previousQrcFiles;
+	previousQrcFiles.swap(qrcFiles_);
+	qrcFiles_ = qrcFiles;
+	sort(qrcFiles_.begin(), qrcFiles_.end());
+	qrcFiles_.erase(unique(qrcFiles_.begin(), qrcFiles_.end()), qrcFiles_.end());
+	resources_.clear();
+
+	set<Key> previousShared;
+	previousShared.swap(shared_);
+
+	// only the files of these qrc files are kept
+	map<string, Hash> previous;
+	previous.swap(hashes_);
+
+	// the qrc files embedding each contents, and the files having them
+	map<Key, set<string> > embedders;
+	map<Key, set<string> > files;
+	for (size_t i=0; i<qrcFiles_.size(); ++i) {
+		vector<Resource>& resources = resources_[qrcFiles_[i]];
+		if (!parseQrc(qrcFiles_[i], resources)) {
+			continue;
+		}
+		for (size_t j=0; j<resources.size(); ++j) {
+			// the unit has no locale, the translated files stay in their qrc file
+			if (resources[j].lang.size() > 0) {
+				continue;
+			}
+			Key key;
+			if (hashFile(resources[j].file, previous, cache) && keyOf(resources[j].file, key)) {
+				embedders[key].insert(qrcFiles_[i]);
+				files[key].insert(resources[j].file);
+			}
+		}
+	}
+
+	// files of the same size and hash could still differ
+	for (auto it = embedders.begin(); it != embedders.end(); ++it) {
+		if (it->second.size() < 2) {
+			continue;
+		}
+		const set<string>& keyFiles = files[it->first];
+		bool compared = previousShared.find(it->first) != previousShared.end();
+		for (auto file = keyFiles.begin(); compared && file != keyFiles.end(); ++file) {
+			auto found = previous.find(*file);
+			const Hash& hash = hashes_[*file];
+			compared = found != previous.end() && found->second.mtime != 0 &&
+			           found->second.mtime == hash.mtime && found->second.size == hash.size;
+		}
+		if (compared || sameContents(keyFiles)) {
+			shared_.insert(it->first);
+		}
+	}
+
+	if (qrcFiles_ != previousQrcFiles || shared_ != previousShared ||
+	        hashes_.size() != previous.size()) {
+		changed_ = true;
+	}
+	for (auto it = hashes_.begin(); !changed_ && it != hashes_.end(); ++it) {
+		auto found = previous.find(it->first);
+		changed_ = found == previous.end() || found->second.hash != it->second.hash ||
+		           found->second.size != it->second.size || found->second.mtime != it->second.mtime;
+	}
+}
+
+
+
+bool SharedResources::sameContents(const set<string>& files)
+{
+	string first;
+	string contents;
+	for (auto it = files.begin(); it != files.end(); ++it) {
+		if (!FileCache::readSync(*it, it == files.begin() ? first : contents)) {
+			return false;
+		}
+		if (it != files.begin() && contents != first) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+
+bool SharedResources::hashFile(const string& file, const map<string, Hash>& previous,
+                               FileCache *cache)
+{
+	if (hashes_.find(file) != hashes_.end()) {
+		return true;
+	}
+	FileCache::Info info = cache ? cache->stat(file) : FileCache::statSync(file);
+	if (!info.isFile) {
+		return false;
+	}
+
+	Hash hash;
+	hash.size = info.size;
+	hash.mtime = info.mtime;
+	auto found = previous.find(file);
+	if (found != previous.end() && found->second.mtime != 0 &&
+	        found->second.mtime == hash.mtime && found->second.size == hash.size) {
+		hash.hash = found->second.hash;
+	}
+	else if (!ResourceFingerprint::hashFile(file, hash.size, hash.hash)) {
+		return false;
+	}
+	// a change in the same second would not change the time stamp
+	if (hash.mtime + second >= FileCache::now()) {
+		hash.mtime = 0;
+	}
+	hashes_[file] = hash;
+	return true;
+}
+
+
+
+bool SharedResources::keyOf(const string& file, Key& key) const
+{
+	auto found = hashes_.find(file);
+	if (found == hashes_.end()) {
+		return false;
+	}
+	key = Key(found->second.size, found->second.hash);
+	return true;
+}
+
+
+
+bool SharedResources::isShared(const Resource& resource) const
+{
+	Key key;
+	return resource.lang.empty() && keyOf(resource.file, key) && shared_.find(key) != shared_.end();
+}
+
+
+
+bool SharedResources::shares(const string& qrcFile) const
+{
+	auto found = resources_.find(qrcFile);
+	if (found == resources_.end()) {
+		return false;
+	}
+	for (size_t i=0; i<found->second.size(); ++i) {
+		if (isShared(found->second[i])) {
+			return true;
+		}
+	}
+	return false;
+}
+
+
+
+string SharedResources::qrcContents(const string& qrcFile, const string& dir) const
+{
+	ostringstream buf;
+	buf << "<!DOCTYPE RCC>\n"
+	    << "<!-- Generated by QtGenTools, do not edit. -->\n"
+	    << "<RCC version=\"1.0\">\n";
+
+	auto found = resources_.find(qrcFile);
+	const Resource *group = NULL;
+	for (size_t i=0; found != resources_.end() && i<found->second.size(); ++i) {
+		const Resource& res = found->second[i];
+		if (isShared(res)) {
+			continue;
+		}
+		if (!group || group->prefix != res.prefix || group->lang != res.lang) {
+			if (group) buf << "</qresource>\n";
+			buf << "<qresource prefix=\"" << escape(res.prefix) << "\"";
+			if (res.lang.size() > 0) buf << " lang=\"" << escape(res.lang) << "\"";
+			buf << ">\n";
+			group = &res;
+		}
+		buf << "\t<file alias=\"" << escape(res.alias) << "\"" << res.attributes << ">"
+		    << escape(fu::relativePath(res.file, dir)) << "</file>\n";
+	}
+	if (group) buf << "</qresource>\n";
+
+	buf << "</RCC>\n";
+	return buf.str();
+}
+
+
+
+unsigned long long SharedResources::signature(const string& name, const string& rccOpts,
+                                              const string& prefixHeader) const
+{
+	if (shared_.empty()) {
+		return 0;
+	}
+
+	unsigned long long h = su::hash(name.c_str(), name.size() + 1);
+	h = su::hash(rccOpts.c_str(), rccOpts.size() + 1, h);
+	h = su::hash(prefixHeader.c_str(), prefixHeader.size() + 1, h);
+	for (size_t i=0; i<qrcFiles_.size(); ++i) {
+		auto found = resources_.find(qrcFiles_[i]);
+		for (size_t j=0; found != resources_.end() && j<found->second.size(); ++j) {
+			const Resource& res = found->second[j];
+			Key key;
+			if (!isShared(res) || !keyOf(res.file, key)) {
+				continue;
+			}
+			ostringstream entry;
+			entry << res.prefix << res.alias << '\t' << key.first << '\t' << key.second << '\n';
+			string str = entry.str();
+			h = su::hash(str.data(), str.size(), h);
+		}
+	}
+	return h;
+}
+
+
+
+string SharedResources::unitQrcContents(const string& dir, unsigned long long signature) const
+{
+	ostringstream buf;
+	buf << "<!DOCTYPE RCC>\n"
+	    << "<!-- Generated by QtGenTools, do not edit. -->\n"
+	    << signatureLine << su::toHex(signature) << " -->\n"
+	    << "<RCC version=\"1.0\">\n";
+
+	// each path once, the first qrc file giving it wins
+	set<string> paths;
+	string prefix;
+	for (size_t i=0; i<qrcFiles_.size(); ++i) {
+		auto found = resources_.find(qrcFiles_[i]);
+		for (size_t j=0; found != resources_.end() && j<found->second.size(); ++j) {
+			const Resource& res = found->second[j];
+			if (!isShared(res) || !paths.insert(res.prefix + res.alias).second) {
+				continue;
+			}
+			if (prefix != res.prefix) {
+				if (prefix.size() > 0) buf << "</qresource>\n";
+				buf << "<qresource prefix=\"" << escape(res.prefix) << "\">\n";
+				prefix = res.prefix;
+			}
+			buf << "\t<file alias=\"" << escape(res.alias) << "\"" << res.attributes << ">"
+			    << escape(fu::relativePath(res.file, dir)) << "</file>\n";
+		}
+	}
+	if (prefix.size() > 0) buf << "</qresource>\n";
+
+	buf << "</RCC>\n";
+	return buf.str();
+}
+
+
+
+unsigned long long SharedResources::unitSignature(const string& qrcFile)
+{
+	ifstream in (qrcFile);
+	string line;
+	for (int i=0; i<8 && getline(in, line); ++i) {
+		if (su::beginsWith(line, string(signatureLine))) {
+			return strtoull(line.c_str() + strlen(signatureLine), NULL, 16);
+		}
+	}
+	return 0;
+}
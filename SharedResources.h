@@ -0,0 +1,122 @@
+/*
+	Copyright (c) 2013, Remi Thebault
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+		* Redistributions of source code must retain the above copyright
+		  notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above copyright
+		  notice, this list of conditions and the following disclaimer in the
+		  documentation and/or other materials provided with the distribution.
+		* Neither the name of the <organization> nor the
+		  names of its contributors may be used to endorse or promote products
+		  derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+	DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "FileCache.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <utility>
+
+
+// Resources embedded by several qrc files, generated once for all of them.
+// A file whose contents (the same bytes, whatever its path) are embedded by
+// at least two qrc files is left out of the qrc files given to rcc, and a
+// common resource unit registers these contents once, under every path the
+// qrc files give them. rcc generates the unit from a qrc file listing
+// these paths; the rcc of Qt 6 stores the bytes once, whatever the number
+// of their paths, older ones once per path.
+// The hashes of the files are kept between runs with their sizes and
+// modification times, only the files whose size or time changed are read
+// again.
+class SharedResources {
+public:
+
+	SharedResources() : changed_(false) {}
+
+	// a file embedded by a qrc file
+	struct Resource {
+		std::string prefix;		// of its qresource element, between slashes
+		std::string lang;
+		std::string alias;		// path under the prefix
+		std::string file;
+		std::string attributes;	// the other ones of its file element, as written
+	};
+
+	// The resources of a qrc file in order, its directories replaced by
+	// their files. False if the file cannot be read.
+	static bool parseQrc(const std::string& qrcFile, std::vector<Resource>& resources);
+
+	// a missing or invalid file gives no qrc file and no hash
+	void load(const std::string& path);
+	// does nothing if nothing changed since loaded
+	bool save(const std::string& path);
+
+	// qrc files of the last update, or of the loaded run
+	const std::vector<std::string>& qrcFiles() const {
+		return qrcFiles_;
+	}
+
+	// Finds the contents embedded by several of these qrc files: the files
+	// of the same size and hash are compared, unless they were found the
+	// same at the previous update. Files are stat'ed through the cache if
+	// not NULL.
+	void update(const std::vector<std::string>& qrcFiles, FileCache *cache);
+
+	// true if some resources of the qrc file are shared
+	bool shares(const std::string& qrcFile) const;
+	// the qrc file to give to rcc, without the shared resources, written
+	// with file paths relative to dir
+	std::string qrcContents(const std::string& qrcFile, const std::string& dir) const;
+
+	// identifies the unit of this name generated with these rcc options:
+	// the shared contents and their paths, 0 if nothing is shared
+	unsigned long long signature(const std::string& name, const std::string& rccOpts,
+	                             const std::string& prefixHeader) const;
+	// The qrc file to give to rcc for the unit: every path of the shared
+	// contents, the first qrc file giving a path wins. Written with file
+	// paths relative to dir, and the signature of the unit.
+	std::string unitQrcContents(const std::string& dir, unsigned long long signature) const;
+	// signature in a qrc file of the unit, 0 if there is none
+	static unsigned long long unitSignature(const std::string& qrcFile);
+
+private:
+
+	// contents: size and hash
+	typedef std::pair<unsigned long long, std::string> Key;
+
+	struct Hash {
+		unsigned long long size;
+		unsigned long long mtime;	// 0 if the hash must be computed again
+		std::string hash;			// SHA-256
+	};
+
+	bool hashFile(const std::string& file, const std::map<std::string, Hash>& previous,
+	              FileCache *cache);
+	bool keyOf(const std::string& file, Key& key) const;
+	bool isShared(const Resource& resource) const;
+	// true if the files have the same bytes
+	static bool sameContents(const std::set<std::string>& files);
+
+	std::vector<std::string> qrcFiles_;
+	std::map<std::string, std::vector<Resource> > resources_;
+	std::map<std::string, Hash> hashes_;	// of the existing files
+	std::set<Key> shared_;
+	bool changed_;
+};
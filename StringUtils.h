@@ -27,6 +27,9 @@
 #pragma once
 
 #include <string>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
 #include <functional>
 #include <cctype>
 
@@ -69,7 +72,7 @@ namespace su {
 		size_t len = pattern.size();
 		while (pos != std::string::npos) {
 			s.replace(pos, len, repl);
-			pos = s.find(pattern);
+			pos = s.find(pattern, pos + repl.size());
 		}
 		return s;
 	}
@@ -96,12 +99,37 @@ namespace su {
 
 
 
+	// 64 bits FNV-1a, stable across platforms and runs
+	inline unsigned long long hash(const char *data, size_t size,
+	                               unsigned long long h = 14695981039346656037ULL)
+	{
+		for (size_t i=0; i<size; ++i) {
+			h ^= static_cast<unsigned char>(data[i]);
+			h *= 1099511628211ULL;
+		}
+		return h;
+	}
+
+	inline unsigned long long hash(const std::string& str)
+	{
+		return hash(str.data(), str.size());
+	}
+
+	// 16 hexadecimal digits, as the hashes are written in the state files
+	inline std::string toHex(unsigned long long value)
+	{
+		std::ostringstream out;
+		out << std::hex << std::setw(16) << std::setfill('0') << value;
+		return out.str();
+	}
+
+
+
 	template<typename CharT>
 	inline bool endsWith(const std::basic_string<CharT>& str, const std::basic_string<CharT>& pattern)
 	{
-		size_t pos = str.find(pattern);
-		if (pos == std::basic_string<CharT>::npos) return false;
-		return pos == (str.size() - pattern.size());
+		if (pattern.size() > str.size()) return false;
+		return 0 == str.compare(str.size() - pattern.size(), pattern.size(), pattern);
 	}
 
 }
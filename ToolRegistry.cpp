@@ -0,0 +1,91 @@
+/*
+	Copyright (c) 2013, Remi Thebault
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+		* Redistributions of source code must retain the above copyright
+		  notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above copyright
+		  notice, this list of conditions and the following disclaimer in the
+		  documentation and/or other materials provided with the distribution.
+		* Neither the name of the <organization> nor the
+		  names of its contributors may be used to endorse or promote products
+		  derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+	DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "ToolRegistry.h"
+
+
+using namespace std;
+
+
+
+namespace {
+
+	QtTool *createGeneric(const char *name, const char *ext,
+	                      const char *outPattern, const char *args)
+	{
+		return new QtGenericTool(name, name, vector<string>(1, ext), outPattern, args);
+	}
+
+}
+
+
+
+ToolRegistry::ToolRegistry()
+{
+	add("moc", [] () -> QtTool * { return new QtMocTool; });
+	add("uic", [] () -> QtTool * { return new QtUicTool; });
+	add("rcc", [] () -> QtTool * { return new QtRccTool; });
+
+	add("lrelease", [] () {
+		return createGeneric("lrelease", ".ts", "@BASE@.qm", "@IN@ -qm @OUT@");
+	});
+	add("qmlcachegen", [] () {
+		return createGeneric("qmlcachegen", ".qml", "qc_@BASE@.cc", "-o @OUT@ @IN@");
+	});
+	// repc [options] <input> <output>, -o gives the output type
+	add("repc", [] () {
+		return createGeneric("repc", ".rep", "rep_@BASE@_replica.h", "-o replica @IN@ @OUT@");
+	});
+}
+
+
+
+void ToolRegistry::add(const string& name, const Factory& factory)
+{
+	factories_[name] = factory;
+}
+
+
+
+vector<string> ToolRegistry::names() const
+{
+	vector<string> res;
+	for (auto it = factories_.begin(); it != factories_.end(); ++it) {
+		res.push_back(it->first);
+	}
+	return res;
+}
+
+
+
+unique_ptr<QtTool> ToolRegistry::create(const string& name) const
+{
+	auto found = factories_.find(name);
+	if (found == factories_.end()) {
+		return unique_ptr<QtTool>();
+	}
+	return unique_ptr<QtTool>(found->second());
+}
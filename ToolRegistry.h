@@ -0,0 +1,62 @@
+/*
+	Copyright (c) 2013, Remi Thebault
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+		* Redistributions of source code must retain the above copyright
+		  notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above copyright
+		  notice, this list of conditions and the following disclaimer in the
+		  documentation and/or other materials provided with the distribution.
+		* Neither the name of the <organization> nor the
+		  names of its contributors may be used to endorse or promote products
+		  derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+	DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "QtTool.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <functional>
+
+
+// Named factories of the tools a Driver can run.
+// moc, uic, rcc, lrelease (.ts), qmlcachegen (.qml) and repc (.rep) are
+// registered by default. Other QtTool subclasses can be added.
+class ToolRegistry {
+public:
+
+	typedef std::function<QtTool *()> Factory;
+
+	ToolRegistry();
+
+	void add(const std::string& name, const Factory& factory);
+
+	bool has(const std::string& name) const {
+		return factories_.find(name) != factories_.end();
+	}
+
+	std::vector<std::string> names() const;
+
+	// returns NULL if the name is not registered
+	std::unique_ptr<QtTool> create(const std::string& name) const;
+
+private:
+
+	std::map<std::string, Factory> factories_;
+};
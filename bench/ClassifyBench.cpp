@@ -0,0 +1,160 @@
+/*
+	Copyright (c) 2013, Remi Thebault
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+		* Redistributions of source code must retain the above copyright
+		  notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above copyright
+		  notice, this list of conditions and the following disclaimer in the
+		  documentation and/or other materials provided with the distribution.
+		* Neither the name of the <organization> nor the
+		  names of its contributors may be used to endorse or promote products
+		  derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+	DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Compares the extension table routing with asking every tool in turn
+// (virtual isCandidate calls), on a synthetic list of paths. Both are
+// checked against the classification of the baseline chain.
+//
+// Usage: ClassifyBench [<number of paths>]
+
+#include "ExtensionTable.h"
+#include "ToolRegistry.h"
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+
+using namespace std;
+
+
+
+namespace {
+
+	const char *exts[] = {
+		".cpp", ".cpp", ".cpp", ".cpp", ".h", ".h", ".h", ".hpp", ".png", ".png",
+		".txt", ".ui", ".qrc", ".ts", ".qml", ".rep", ".json", ".h.bak.h", "", ".cmake"
+	};
+
+	// The classification before the extension table, written out so that
+	// a change of isCandidate or of the table shows up as mismatches: each
+	// tool in turn checks the end of the path, as the isFileInput chain of
+	// moc, uic and rcc did (without the Q_OBJECT scan of moc, which also
+	// takes sources now), then the registered tools.
+	const char *baselineChain[][9] = {
+		{ "moc", ".h", ".hpp", ".hh", ".hxx", ".cpp", ".cc", ".cxx", NULL },
+		{ "uic", ".ui", NULL },
+		{ "rcc", ".qrc", NULL },
+		{ "lrelease", ".ts", NULL },
+		{ "qmlcachegen", ".qml", NULL },
+		{ "repc", ".rep", NULL }
+	};
+
+	string baselineTool(const string& path)
+	{
+		for (size_t i=0; i<sizeof(baselineChain)/sizeof(baselineChain[0]); ++i) {
+			for (size_t j=1; baselineChain[i][j]; ++j) {
+				string ext = baselineChain[i][j];
+				if (path.size() >= ext.size() &&
+				        path.compare(path.size() - ext.size(), ext.size(), ext) == 0) {
+					return baselineChain[i][0];
+				}
+			}
+		}
+		return string();
+	}
+
+	vector<string> makePaths(size_t count)
+	{
+		vector<string> paths;
+		paths.reserve(count);
+		unsigned long long seed = 42;
+		for (size_t i=0; i<count; ++i) {
+			seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+			unsigned r = unsigned(seed >> 33);
+			string path = "/work/src/module" + to_string(r % 97) +
+			              "/sub" + to_string((r >> 8) % 13) +
+			              "/file" + to_string(i) +
+			              exts[(r >> 16) % (sizeof(exts) / sizeof(exts[0]))];
+			paths.push_back(path);
+		}
+		return paths;
+	}
+
+}
+
+
+
+int main(int argc, char *argv[])
+{
+	size_t count = (argc > 1) ? size_t(strtoull(argv[1], NULL, 10)) : 1000000;
+
+	ToolRegistry registry;
+	vector<unique_ptr<QtTool> > owned;
+	vector<QtTool *> tools;
+	const char *names[] = { "moc", "uic", "rcc", "lrelease", "qmlcachegen", "repc" };
+	for (size_t i=0; i<sizeof(names)/sizeof(names[0]); ++i) {
+		owned.push_back(registry.create(names[i]));
+		tools.push_back(owned.back().get());
+	}
+
+	vector<string> paths = makePaths(count);
+	vector<QtTool *> probed (paths.size());
+	vector<QtTool *> routed (paths.size());
+
+	auto start = chrono::steady_clock::now();
+	for (size_t i=0; i<paths.size(); ++i) {
+		QtTool *found = NULL;
+		for (size_t j=0; j<tools.size(); ++j) {
+			if (tools[j]->isCandidate(paths[i])) {
+				found = tools[j];
+				break;
+			}
+		}
+		probed[i] = found;
+	}
+	double probeMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+	start = chrono::steady_clock::now();
+	ExtensionTable table;
+	table.build(tools);
+	for (size_t i=0; i<paths.size(); ++i) {
+		routed[i] = table.find(paths[i]);
+	}
+	double tableMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+	size_t probeMismatches = 0;
+	size_t tableMismatches = 0;
+	size_t inputs = 0;
+	for (size_t i=0; i<paths.size(); ++i) {
+		string expected = baselineTool(paths[i]);
+		if (expected != (probed[i] ? probed[i]->name() : "")) ++probeMismatches;
+		if (expected != (routed[i] ? routed[i]->name() : "")) ++tableMismatches;
+		if (routed[i]) ++inputs;
+	}
+
+	cout << paths.size() << " paths, " << inputs << " tool inputs\n";
+	cout << "per-tool probing: " << probeMs << " ms, "
+	     << probeMismatches << " mismatches with the baseline chain\n";
+	cout << "extension table:  " << tableMs << " ms, "
+	     << tableMismatches << " mismatches with the baseline chain\n";
+
+	return probeMismatches == 0 && tableMismatches == 0 ? 0 : 1;
+}
@@ -26,221 +26,24 @@
 */
 #include "StringUtils.h"
 #include "FileUtils.h"
-#include "QtTool.h"
+#include "Driver.h"
+#include "Report.h"
 #include "Version.h"
 
-#ifdef _WIN32
-#include <Windows.h>
-#endif
-
-#include <algorithm>
 #include <iostream>
-#include <iomanip>
 #include <sstream>
-#include <fstream>
 #include <iterator>
 #include <string>
 #include <vector>
 #include <stdexcept>
 #include <cstdlib>
-#include <cstdio>
+#include <cctype>
 
 
 using namespace std;
 
 
 
-string guessQtBinPath()
-{
-	string qtBinPath;
-	char *qt = getenv("QT5");
-	if (qt) {
-		qtBinPath = string(qt);
-		if (qtBinPath.back() != fu::pathSep) qtBinPath.push_back(fu::pathSep);
-		qtBinPath.append("bin");
-		qtBinPath.push_back(fu::pathSep);
-	}
-	else {
-		string path = string(getenv("PATH"));
-		vector<string> pathComps;
-		su::split(path, fu::pathVarSep, back_inserter(pathComps));
-		for (size_t i=0; i<pathComps.size(); ++i) {
-			string p = pathComps[i];
-			if (p.back() != fu::pathSep) p.push_back(fu::pathSep);
-#ifdef _WIN32
-			string qmake = p + string("qmake.exe");
-#else
-			string qmake = p + string("qmake");
-#endif
-			ifstream test (qmake, ios::binary);
-			if (test) {
-				test.close();
-				qtBinPath = p;
-				break;
-			}
-		}
-	}
-	return qtBinPath;
-}
-
-
-
-string qtBinPath;
-string inD;
-string outD;
-
-QtMocTool moc;
-QtUicTool uic;
-QtRccTool rcc;
-
-
-
-class Driver {
-public:
-
-	void run() {
-
-		tools_.clear();
-		oldFiles_.clear();
-		newFiles_.clear();
-		genFiles_.clear();
-		updatedFiles_.clear();
-		untouchedFiles_.clear();
-		deletedFiles_.clear();
-		errors_.clear();
-
-		tools_.push_back(&moc);
-		tools_.push_back(&uic);
-		tools_.push_back(&rcc);
-
-		for (int i=0; i<3; ++i) {
-			tools_[i]->init(qtBinPath);
-		}
-
-		if (inD.back() != fu::pathSep) inD.push_back(fu::pathSep);
-		if (outD.back() != fu::pathSep) outD.push_back(fu::pathSep);
-
-		if (!fu::isDir(outD)) {
-			if (!fu::mkDir(outD)) {
-				throw runtime_error("could not create the output directory");
-			}
-		}
-
-		fu::listDir(outD, back_inserter(oldFiles_));
-		for (size_t i=0; i<oldFiles_.size(); ++i) {
-			oldFiles_[i] = outD + oldFiles_[i];
-		}
-
-		fu::walk(inD, *this);
-
-
-		for (size_t i=0; i<oldFiles_.size(); ++i) {
-			auto found = find(newFiles_.begin(), newFiles_.end(), oldFiles_[i]);
-			if (found == newFiles_.end()) {
-				if (fu::rm(oldFiles_[i])) {
-					deletedFiles_.push_back(oldFiles_[i]);
-				}
-				else {
-					cerr << "could not delete " << oldFiles_[i] << "\n";
-				}
-			}
-		}
-
-
-		// printing report
-		string sep (79, '-');
-		cout << sep << '\n';
-		cout << ' ' << inD << '\n';
-		cout << sep << '\n';
-
-		if (genFiles_.size() > 0) {
-			for (size_t i=0; i<genFiles_.size(); ++i) {
-				cout << "generated: " << genFiles_[i] << '\n';
-			}
-			cout << sep << '\n';
-		}
-
-		if (updatedFiles_.size() > 0) {
-			for (size_t i=0; i<updatedFiles_.size(); ++i) {
-				cout << "updated: " << updatedFiles_[i] << '\n';
-			}
-			cout << sep << '\n';
-		}
-
-		if (deletedFiles_.size() > 0) {
-			for (size_t i=0; i<deletedFiles_.size(); ++i) {
-				cout << "deleted: " << deletedFiles_[i] << '\n';
-			}
-			cout << sep << '\n';
-		}
-
-		cout << untouchedFiles_.size() << " file(s) were already up-to-date\n";
-		cout << genFiles_.size() << " file(s) have been generated\n";
-		cout << updatedFiles_.size() << " file(s) have been updated\n";
-		cout << deletedFiles_.size() << " file(s) have been deleted\n";
-
-		if (errors_.size() > 0) {
-			cout << sep << '\n';
-			cout << "error occured when processing the following file(s):\n";
-			for (size_t i=0; i<errors_.size(); ++i) {
-				cout << errors_[i] << '\n';
-			}
-		}
-	}
-
-
-	void operator()(const string& root, const string& filename, bool isdir) {
-
-		string inFile = root + filename;
-
-		for (int i=0; i<3; ++i) {
-			QtTool *tool = tools_[i];
-			if(tool->isFileInput(inFile)) {
-
-				string outFilename = tool->getOutFilename(filename);
-				string outFile = outD + outFilename;
-
-				try {
-					bool existed = fu::isFile(outFile);
-
-					if (tool->runIfNeeded(inFile, outFile)) {
-						if (existed) {
-							updatedFiles_.push_back(outFile);
-						}
-						else {
-							genFiles_.push_back(outFile);
-						}
-					}
-					else {
-						untouchedFiles_.push_back(outFile);
-					}
-					newFiles_.push_back(outFile);
-				}
-				catch (const runtime_error& err) {
-					ostringstream out;
-					out << filename << ": " << err.what();
-					errors_.push_back(out.str());
-				}
-				break;
-			}
-		}
-	}
-
-private:
-
-	vector<QtTool *> tools_;
-	vector<string> oldFiles_;
-	vector<string> newFiles_;
-	vector<string> genFiles_;
-	vector<string> updatedFiles_;
-	vector<string> untouchedFiles_;
-	vector<string> deletedFiles_;
-	vector<string> errors_;
-};
-
-
-
-
 void usage(const string& err="")
 {
 	if (err.size() > 0) {
@@ -248,6 +51,8 @@ void usage(const string& err="")
 	}
 	cout <<
 		"Usage: QtGenTools --inD=<IN_DIR> --outD=<OUT_DIR> [Options]\n"
+		"       QtGenTools --inD=<IN_DIR> --toolchain=<NAME>,<QT_BIN>,<OUT_DIR>... [Options]\n"
+		"       QtGenTools --merge=<DIR>[,<DIR>...] --outD=<OUT_DIR> [--report=<format>]\n"
 		"       QtGenTools --version\n"
 		"       QtGenTools --help\n"
 		"    version " VERSION_STR "\n"
@@ -257,14 +62,128 @@ void usage(const string& err="")
 		"  --mocOpts=<opts>  Command line options given to moc\n"
 		"  --uicOpts=<opts>  Command line options given to uic\n"
 		"  --rccOpts=<opts>  Command line options given to rcc\n"
+		"  --rccMode=[<name.qrc>:]<mode>\n"
+		"                    How rcc is run for all or one qrc file. <mode> is one of:\n"
+		"                      embed:  rc_<name>.cc with embedded resources (default)\n"
+		"                      binary: external <name>.rcc (rcc --binary)\n"
+		"                      big:    rc_<name>.cc from rcc --pass 1, and\n"
+		"                              rc_<name>.pass2 with the second pass command\n"
+		"                      auto:   big if resources exceed --rccThreshold, else embed\n"
+		"  --rccThreshold=<bytes>\n"
+		"                    Resources size above which auto mode uses big (8MiB)\n"
+		"  --rccFingerprint  Run rcc when the contents of the resources change,\n"
+		"                    not their modification times\n"
+		"  --rccShared[=<name>]\n"
+		"                    Embed the resources of several qrc files once, in\n"
+		"                    rc_<name>.cc (rc_qtgentools_shared.cc)\n"
+		"  --tool=<name>     Also run a registered tool: lrelease (.ts -> <name>.qm),\n"
+		"                    qmlcachegen (.qml -> qc_<name>.cc) or\n"
+		"                    repc (.rep -> rep_<name>_replica.h)\n"
+		"  --tool=<name>:<exe>:<exts>:<outPattern>:<args>\n"
+		"                    Also run a custom tool. <exts> are comma separated,\n"
+		"                    @BASE@ in <outPattern> is the input base name, @IN@\n"
+		"                    and @OUT@ in <args> are the input and output files.\n"
+		"                    <exe> may start with a drive letter, <args> may\n"
+		"                    contain colons\n"
+		"  --toolOpts=<name>:<opts>\n"
+		"                    Command line options given to a tool\n"
+		"  --toolExt=<name>:<exts>\n"
+		"                    Comma separated input extensions of a tool\n"
+		"  --toolOut=<name>:<outPattern>\n"
+		"                    Output file name of a tool\n"
+		"  --shard=<i>/<n>   Only generate the shard i (1 to n) of the inputs\n"
+		"  --merge=<dirs>    Merge the comma separated shard output directories\n"
+		"                    into the output directory\n"
+		"  --report=<format> Report format: text (default), json or ndjson\n"
+		"  --explain         Report why each tool was run\n"
+		"  --jobs=<n>        Tool runs at the same time (number of CPUs)\n"
+		"  --pathBase=<dir>  Run the tools with paths relative to this directory\n"
+		"  --prefixHeader[=<name>]\n"
+		"                    Write a header to precompile in the output directory\n"
+		"                    (qtgentools_prefix.h), included first by the moc and\n"
+		"                    rcc outputs\n"
+		"  --ioUring         Batch file system accesses with io_uring (Linux)\n"
+		"  --index           Report the sources including each changed output\n"
+		"  --snapshot        Only list the input directories modified since the\n"
+		"                    previous run\n"
+		"  --gitIndex        Take the input files from the git index\n"
+		"  --symlinks=<policy>\n"
+		"                    follow (default) or nofollow the symbolic links of\n"
+		"                    the input directory\n"
+		"  --only=<files>    Only check these comma separated input files, or the\n"
+		"                    files read from the standard input, one per line, if\n"
+		"                    <files> is -. Stale outputs are not deleted\n"
+		"  --toolchain=<name>,<qt_bin_dir>,<out_dir>\n"
+		"                    Generate with this Qt into this directory. Repeat for\n"
+		"                    each toolchain, --qt and --outD are then not used\n"
+		"  --toolchainOpts=<name>,<tool>,<opts>\n"
+		"                    Command line options given to a tool of a toolchain\n"
 		"  --version         Prints the version and exits\n"
 		"  --help            Prints this message and exits\n";
 }
 
 
 
+ToolConfig& toolConfig(DriverConfig& config, const string& name)
+{
+	for (size_t i=0; i<config.tools.size(); ++i) {
+		if (config.tools[i].name == name) {
+			return config.tools[i];
+		}
+	}
+	config.tools.push_back(ToolConfig());
+	config.tools.back().name = name;
+	return config.tools.back();
+}
+
+
+
+ToolchainConfig& toolchainConfig(DriverConfig& config, const string& name)
+{
+	for (size_t i=0; i<config.toolchains.size(); ++i) {
+		if (config.toolchains[i].name == name) {
+			return config.toolchains[i];
+		}
+	}
+	config.toolchains.push_back(ToolchainConfig());
+	config.toolchains.back().name = name;
+	return config.toolchains.back();
+}
+
+
+
+// name:exe:exts:outPattern:args split in these fields, or the name alone.
+// The executable may start with a drive letter, the arguments may contain
+// colons.
+vector<string> splitToolSpec(const string& spec)
+{
+	vector<string> fields;
+	size_t start = 0;
+	while (fields.size() < 4) {
+		size_t from = start;
+		if (fields.size() == 1 && spec.size() > start+2 && isalpha((unsigned char)spec[start]) &&
+		        spec[start+1] == ':' && (spec[start+2] == '\\' || spec[start+2] == '/')) {
+			from = start + 2;
+		}
+		size_t sep = spec.find(':', from);
+		if (sep == string::npos) {
+			break;
+		}
+		fields.push_back(spec.substr(start, sep - start));
+		start = sep + 1;
+	}
+	fields.push_back(spec.substr(start));
+	return fields;
+}
+
+
+
 int main (int argc, char *argv[])
 {
+	DriverConfig config;
+	ReportFormat report = TextReport;
+	bool explain = false;
+	vector<string> mergeDirs;
 
 	for (int i=1; i<argc; ++i) {
 		string arg = string(argv[i]);
@@ -277,58 +196,265 @@ int main (int argc, char *argv[])
 			return 0;
 		}
 		else if (su::beginsWith(arg, string("--qt="))) {
-			qtBinPath = arg.substr(5);
-			if (qtBinPath.back() == '\\') qtBinPath.push_back('\\');
-			qtBinPath += "bin\\";
+			config.qtBinPath = arg.substr(5);
+			if (config.qtBinPath.back() == '\\') config.qtBinPath.push_back('\\');
+			config.qtBinPath += "bin\\";
+		}
+		else if (su::beginsWith(arg, string("--report="))) {
+			if (!parseReportFormat(arg.substr(9), report)) {
+				usage("invalid report format: " + arg.substr(9));
+				return 1;
+			}
+		}
+		else if (su::beginsWith(arg, string("--shard="))) {
+			string val = arg.substr(8);
+			size_t sep = val.find('/');
+			if (sep != string::npos) {
+				config.shardIndex = unsigned(strtoul(val.substr(0, sep).c_str(), NULL, 10));
+				config.shardCount = unsigned(strtoul(val.substr(sep+1).c_str(), NULL, 10));
+			}
+			if (sep == string::npos || config.shardCount == 0 ||
+			        config.shardIndex < 1 || config.shardIndex > config.shardCount) {
+				usage("invalid shard: " + val);
+				return 1;
+			}
+		}
+		else if (su::beginsWith(arg, string("--merge="))) {
+			su::split(arg.substr(8), ',', back_inserter(mergeDirs));
+		}
+		else if (su::beginsWith(arg, string("--only="))) {
+			vector<string> files;
+			if (arg == "--only=-") {
+				// one file per line, as an IDE or a file watcher writes them
+				string line;
+				while (getline(cin, line)) {
+					files.push_back(su::trim(line));
+				}
+			}
+			else {
+				su::split(arg.substr(7), ',', back_inserter(files));
+			}
+			for (size_t i=0; i<files.size(); ++i) {
+				if (files[i].size() > 0) config.only.push_back(files[i]);
+			}
+		}
+		else if (su::beginsWith(arg, string("--symlinks="))) {
+			string val = arg.substr(11);
+			if (val == "follow") {
+				config.symlinks = fu::FollowSymlinks;
+			}
+			else if (val == "nofollow") {
+				config.symlinks = fu::SkipSymlinks;
+			}
+			else {
+				usage("invalid symlinks policy: " + val);
+				return 1;
+			}
+		}
+		else if (arg == "--prefixHeader") {
+			config.prefixHeader = "qtgentools_prefix.h";
+		}
+		else if (su::beginsWith(arg, string("--prefixHeader="))) {
+			config.prefixHeader = arg.substr(15);
+		}
+		else if (su::beginsWith(arg, string("--pathBase="))) {
+			config.pathBase = arg.substr(11);
+			// every path is under the root, none would stay absolute
+			if (config.pathBase.empty() || fu::isRoot(config.pathBase)) {
+				usage("invalid path base: " + config.pathBase);
+				return 1;
+			}
+		}
+		else if (su::beginsWith(arg, string("--jobs="))) {
+			config.jobs = unsigned(strtoul(arg.substr(7).c_str(), NULL, 10));
+			if (config.jobs == 0) {
+				usage("invalid jobs: " + arg.substr(7));
+				return 1;
+			}
+		}
+		else if (arg == "--explain") {
+			explain = true;
+		}
+		else if (arg == "--ioUring") {
+			config.ioUring = true;
+		}
+		else if (arg == "--index") {
+			config.index = true;
+		}
+		else if (arg == "--snapshot") {
+			config.snapshot = true;
+		}
+		else if (arg == "--gitIndex") {
+			config.gitIndex = true;
 		}
 		else if (su::beginsWith(arg, string("--inD="))) {
-			inD = arg.substr(6);
+			config.inD = arg.substr(6);
 		}
 		else if (su::beginsWith(arg, string("--outD="))) {
-			outD = arg.substr(7);
+			config.outD = arg.substr(7);
 		}
 		else if (su::beginsWith(arg, string("--mocOpts="))) {
-			moc.setCmdOpts(arg.substr(10));
+			config.mocOpts = arg.substr(10);
 		}
 		else if (su::beginsWith(arg, string("--uicOpts="))) {
-			uic.setCmdOpts(arg.substr(10));
+			config.uicOpts = arg.substr(10);
 		}
 		else if (su::beginsWith(arg, string("--rccOpts="))) {
-			rcc.setCmdOpts(arg.substr(10));
+			config.rccOpts = arg.substr(10);
+		}
+		else if (su::beginsWith(arg, string("--tool="))) {
+			vector<string> fields = splitToolSpec(arg.substr(7));
+			if (fields.size() != 1 && fields.size() != 5) {
+				usage("invalid tool: " + arg.substr(7));
+				return 1;
+			}
+			ToolConfig& tc = toolConfig(config, fields[0]);
+			if (fields.size() == 5) {
+				tc.exe = fields[1];
+				su::split(fields[2], ',', back_inserter(tc.extensions));
+				tc.outPattern = fields[3];
+				tc.args = fields[4];
+			}
+		}
+		else if (su::beginsWith(arg, string("--toolOpts=")) ||
+		         su::beginsWith(arg, string("--toolExt=")) ||
+		         su::beginsWith(arg, string("--toolOut="))) {
+			size_t eq = arg.find('=');
+			string val = arg.substr(eq+1);
+			size_t sep = val.find(':');
+			if (sep == string::npos) {
+				usage("invalid tool option: " + arg);
+				return 1;
+			}
+			ToolConfig& tc = toolConfig(config, val.substr(0, sep));
+			string opt = arg.substr(0, eq);
+			if (opt == "--toolOpts") {
+				tc.opts = val.substr(sep+1);
+			}
+			else if (opt == "--toolExt") {
+				tc.extensions.clear();
+				su::split(val.substr(sep+1), ',', back_inserter(tc.extensions));
+			}
+			else {
+				tc.outPattern = val.substr(sep+1);
+			}
+		}
+		else if (su::beginsWith(arg, string("--toolchain="))) {
+			vector<string> fields;
+			su::split(arg.substr(12), ',', back_inserter(fields));
+			if (fields.size() != 3 || fields[0].empty()) {
+				usage("invalid toolchain: " + arg.substr(12));
+				return 1;
+			}
+			ToolchainConfig& tc = toolchainConfig(config, fields[0]);
+			tc.qtBinPath = fields[1];
+			tc.outD = fields[2];
+		}
+		else if (su::beginsWith(arg, string("--toolchainOpts="))) {
+			// the options can have commas
+			string val = arg.substr(16);
+			size_t sep1 = val.find(',');
+			size_t sep2 = (sep1 == string::npos) ? sep1 : val.find(',', sep1+1);
+			if (sep2 == string::npos) {
+				usage("invalid toolchain options: " + val);
+				return 1;
+			}
+			ToolchainConfig& tc = toolchainConfig(config, val.substr(0, sep1));
+			tc.toolOpts[val.substr(sep1+1, sep2-sep1-1)] = val.substr(sep2+1);
+		}
+		else if (su::beginsWith(arg, string("--rccMode="))) {
+			string val = arg.substr(10);
+			size_t sep = val.rfind(':');
+			QtRccTool::Mode mode;
+			if (!QtRccTool::parseMode(val.substr(sep == string::npos ? 0 : sep+1), mode)) {
+				usage("invalid rcc mode: " + val);
+				return 1;
+			}
+			if (sep == string::npos) {
+				config.rccMode = mode;
+			}
+			else {
+				config.rccModes[val.substr(0, sep)] = mode;
+			}
+		}
+		else if (su::beginsWith(arg, string("--rccThreshold="))) {
+			config.rccThreshold = strtoull(arg.substr(15).c_str(), NULL, 10);
+		}
+		else if (arg == "--rccFingerprint") {
+			config.rccFingerprint = true;
+		}
+		else if (arg == "--rccShared") {
+			config.rccShared = "qtgentools_shared";
+		}
+		else if (su::beginsWith(arg, string("--rccShared="))) {
+			config.rccShared = arg.substr(12);
 		}
 	}
 
-	if (qtBinPath.size() == 0) {
-		qtBinPath = guessQtBinPath();
+	if (mergeDirs.size() > 0) {
+		if (config.outD.size() == 0) {
+			usage("output directory was not specified");
+			return 1;
+		}
+		try {
+			Driver d;
+			writeReport(d.merge(mergeDirs, config.outD), report, cout);
+		}
+		catch (const runtime_error& err) {
+			cerr << "Error: " << err.what() << "\n";
+			return 1;
+		}
+		return 0;
 	}
 
-	if (qtBinPath.size() == 0) {
-		usage("qt bin path was not found");
+	if (config.inD.size() == 0) {
+		usage("input directory was not specified");
 		return 1;
 	}
 
-	if (!fu::isDir(qtBinPath)) {
-		usage("qt bin directory is not valid");
+	if (!fu::isDir(config.inD)) {
+		usage("input directory is not valid");
 		return 1;
 	}
 
-	if (inD.size() == 0) {
-		usage("input directory was not specified");
-		return 1;
+	// each toolchain has its own Qt and output directory
+	if (config.toolchains.size() > 0) {
+		for (size_t i=0; i<config.toolchains.size(); ++i) {
+			if (config.toolchains[i].outD.empty()) {
+				usage("toolchain options without --toolchain: " + config.toolchains[i].name);
+				return 1;
+			}
+		}
 	}
+	else {
+		if (config.qtBinPath.size() == 0) {
+			config.qtBinPath = guessQtBinPath();
+		}
 
-	if (!fu::isDir(inD)) {
-		usage("input directory is not valid");
-		return 1;
+		if (config.qtBinPath.size() == 0) {
+			usage("qt bin path was not found");
+			return 1;
+		}
+
+		if (!fu::isDir(config.qtBinPath)) {
+			usage("qt bin directory is not valid");
+			return 1;
+		}
+
+		if (config.outD.size() == 0) {
+			usage("output directory was not specified");
+			return 1;
+		}
 	}
 
-	if (outD.size() == 0) {
-		usage("output directory was not specified");
+	try {
+		Driver d;
+		writeReport(d.run(config), report, cout, explain);
+	}
+	catch (const runtime_error& err) {
+		cerr << "Error: " << err.what() << "\n";
 		return 1;
 	}
 
-	Driver d;
-	d.run();
-
 	return 0;
 }
@@ -0,0 +1,89 @@
+/*
+	Copyright (c) 2013, Remi Thebault
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+		* Redistributions of source code must retain the above copyright
+		  notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above copyright
+		  notice, this list of conditions and the following disclaimer in the
+		  documentation and/or other materials provided with the distribution.
+		* Neither the name of the <organization> nor the
+		  names of its contributors may be used to endorse or promote products
+		  derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+	DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Parsing of the dependency files written by moc --output-dep-file.
+
+#include "QtTool.h"
+#include "TestUtils.h"
+
+#include <string>
+#include <vector>
+
+
+using namespace std;
+
+
+
+namespace {
+
+	vector<string> deps(const string& contents)
+	{
+		return QtMocTool::parseDepFile(contents);
+	}
+
+}
+
+
+
+int main()
+{
+	// the target is skipped, the dependencies are separated by spaces
+	vector<string> res = deps("out/moc_a.cpp: src/a.h /qt/include/QObject\n");
+	CHECK_EQ(res.size(), 2u);
+	CHECK_EQ(res.at(0), "src/a.h");
+	CHECK_EQ(res.at(1), "/qt/include/QObject");
+
+	// continued lines, tabs and CRLF
+	res = deps("moc_b.cpp: b.h \\\n\tc.h \\\r\n  d.h\r\n");
+	CHECK_EQ(res.size(), 3u);
+	CHECK_EQ(res.at(0), "b.h");
+	CHECK_EQ(res.at(1), "c.h");
+	CHECK_EQ(res.at(2), "d.h");
+
+	// escaped spaces, hashes and dollars are part of the paths
+	res = deps("moc_c.cpp: my\\ dir/c.h issue\\#1.h price$$.h\n");
+	CHECK_EQ(res.size(), 3u);
+	CHECK_EQ(res.at(0), "my dir/c.h");
+	CHECK_EQ(res.at(1), "issue#1.h");
+	CHECK_EQ(res.at(2), "price$.h");
+
+	// a drive letter is not the separator of the target
+	res = deps("C:/out/moc_d.cpp: C:/src/d.h\n");
+	CHECK_EQ(res.size(), 1u);
+	CHECK_EQ(res.at(0), "C:/src/d.h");
+
+	// a backslash before another character stays (Windows paths)
+	res = deps("moc_e.cpp: src\\e.h\n");
+	CHECK_EQ(res.size(), 1u);
+	CHECK_EQ(res.at(0), "src\\e.h");
+
+	CHECK(deps("").empty());
+	CHECK(deps("moc_f.cpp:").empty());
+	CHECK(deps("moc_g.cpp: \\\n").empty());
+
+	return test::failures();
+}
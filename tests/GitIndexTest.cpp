@@ -0,0 +1,436 @@
+/*
+	Copyright (c) 2013, Remi Thebault
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+		* Redistributions of source code must retain the above copyright
+		  notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above copyright
+		  notice, this list of conditions and the following disclaimer in the
+		  documentation and/or other materials provided with the distribution.
+		* Neither the name of the <organization> nor the
+		  names of its contributors may be used to endorse or promote products
+		  derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+	DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Reading of the git index: the entries of the versions 2 to 4, and the
+// untracked cache extension. Also checked against the index git writes,
+// when git can be run.
+
+#include "GitIndex.h"
+#include "FileCache.h"
+#include "TestUtils.h"
+
+#include <string>
+#include <vector>
+#include <set>
+#include <cstdlib>
+#include <ctime>
+
+
+using namespace std;
+
+
+
+namespace {
+
+	const size_t hashSize = 20;
+
+	void put32(string& buf, unsigned value)
+	{
+		for (int i=3; i>=0; --i) buf.push_back(char((value >> (8*i)) & 0xff));
+	}
+
+	void put16(string& buf, unsigned value)
+	{
+		buf.push_back(char((value >> 8) & 0xff));
+		buf.push_back(char(value & 0xff));
+	}
+
+	void put64(string& buf, unsigned long long value)
+	{
+		put32(buf, unsigned(value >> 32));
+		put32(buf, unsigned(value & 0xffffffffULL));
+	}
+
+	// the variable length integers of git
+	void putVarint(string& buf, size_t value)
+	{
+		unsigned char bytes[16];
+		size_t pos = sizeof(bytes) - 1;
+		bytes[pos] = value & 0x7f;
+		while (value >>= 7) {
+			bytes[--pos] = 0x80 | (--value & 0x7f);
+		}
+		buf.append(reinterpret_cast<char *>(bytes + pos), sizeof(bytes) - pos);
+	}
+
+	string header(unsigned version, unsigned count)
+	{
+		string buf = "DIRC";
+		put32(buf, version);
+		put32(buf, count);
+		return buf;
+	}
+
+	// the stat data and object id of an entry, up to its flags
+	void putStat(string& buf, unsigned mode, unsigned mtime, unsigned size, char hash)
+	{
+		put32(buf, 1);		// ctime
+		put32(buf, 0);
+		put32(buf, mtime);
+		put32(buf, 7);
+		put32(buf, 2);		// dev
+		put32(buf, 3);		// ino
+		put32(buf, mode);
+		put32(buf, 0);		// uid
+		put32(buf, 0);		// gid
+		put32(buf, size);
+		buf.append(hashSize, hash);
+	}
+
+	// an entry of the versions 2 and 3, padded to a multiple of 8
+	void putEntry(string& buf, const string& path, unsigned mode, unsigned mtime = 100,
+	              unsigned size = 10, unsigned stage = 0, bool extended = false)
+	{
+		size_t start = buf.size();
+		putStat(buf, mode, mtime, size, char(path.size()));
+		put16(buf, (extended ? 0x4000 : 0) | (stage << 12) | unsigned(path.size()));
+		if (extended) put16(buf, 0x2000);	// intent to add
+		buf += path;
+		size_t len = buf.size() - start;
+		buf.append(8 - len % 8, '\0');
+	}
+
+	// an entry of the version 4, its path stripping the end of the previous one
+	void putEntryV4(string& buf, size_t strip, const string& suffix, unsigned mode)
+	{
+		putStat(buf, mode, 100, 10, 'h');
+		put16(buf, unsigned(suffix.size()));
+		putVarint(buf, strip);
+		buf += suffix;
+		buf.push_back('\0');
+	}
+
+	void putExtension(string& buf, const char *signature, const string& data)
+	{
+		buf += signature;
+		put32(buf, unsigned(data.size()));
+		buf += data;
+	}
+
+	// the stat data of the untracked cache: ctime, mtime, dev, ino, uid, gid, size
+	void putUntrackedStat(string& buf, unsigned mtime, unsigned size)
+	{
+		put32(buf, 1);
+		put32(buf, 0);
+		put32(buf, mtime);
+		put32(buf, 5);
+		put32(buf, 0);
+		put32(buf, 0);
+		put32(buf, 0);
+		put32(buf, 0);
+		put32(buf, size);
+	}
+
+	// an EWAH bitmap of literal words only
+	void putBitmap(string& buf, const vector<bool>& bits)
+	{
+		vector<unsigned long long> literals ((bits.size() + 63) / 64, 0);
+		for (size_t i=0; i<bits.size(); ++i) {
+			if (bits[i]) literals[i / 64] |= 1ULL << (i % 64);
+		}
+		put32(buf, unsigned(bits.size()));
+		put32(buf, unsigned(literals.size() + 1));
+		put64(buf, static_cast<unsigned long long>(literals.size()) << 33);
+		for (size_t i=0; i<literals.size(); ++i) {
+			put64(buf, literals[i]);
+		}
+		put32(buf, 0);
+	}
+
+	// the root with c.qrc and newdir/, and sub with nothing untracked
+	string untrackedCache()
+	{
+		string data;
+		string ident = "Location /work/repo, system Linux";
+		ident.push_back('\0');
+		putVarint(data, ident.size());
+		data += ident;
+		putUntrackedStat(data, 50, 20);		// info/exclude
+		putUntrackedStat(data, 0, 0);		// core.excludesFile
+		put32(data, 0);						// dir_flags
+		data.append(hashSize, 'i');
+		data.append(hashSize, '\0');		// no core.excludesFile
+		data += ".gitignore";
+		data.push_back('\0');
+
+		putVarint(data, 2);
+		putVarint(data, 2);		// root: untracked entries, sub-directories
+		putVarint(data, 1);
+		data.push_back('\0');
+		data += "c.qrc";
+		data.push_back('\0');
+		data += "newdir/";
+		data.push_back('\0');
+		putVarint(data, 0);
+		putVarint(data, 0);
+		data += "sub";
+		data.push_back('\0');
+
+		vector<bool> valid (2, true);
+		putBitmap(data, valid);
+		putBitmap(data, vector<bool>());
+		putBitmap(data, vector<bool>(1, true));
+		putUntrackedStat(data, 60, 4096);
+		putUntrackedStat(data, 70, 4096);
+		data.append(hashSize, 'g');
+		data.push_back('\0');
+		return data;
+	}
+
+	void testEntries()
+	{
+		string index = header(2, 5);
+		putEntry(index, "a.h", 0100644, 1234, 56);
+		putEntry(index, "conflict.ui", 0100644, 100, 10, 1);
+		putEntry(index, "conflict.ui", 0100644, 100, 10, 2);
+		putEntry(index, "link.h", 0120000);
+		putEntry(index, "module", 0160000);		// gitlink
+		index.append(hashSize, 'x');
+
+		vector<GitIndex::Entry> entries;
+		CHECK(GitIndex::parse(index, hashSize, entries));
+		CHECK_EQ(entries.size(), 3u);
+		if (entries.size() != 3) return;
+		CHECK_EQ(entries[0].path, "a.h");
+		CHECK(!entries[0].link);
+		CHECK_EQ(entries[0].stat.mtime, 1234u);
+		CHECK_EQ(entries[0].stat.mtimeNs, 7u);
+		CHECK_EQ(entries[0].stat.size, 56u);
+		CHECK_EQ(entries[0].hash, string(hashSize, char(3)));
+		CHECK_EQ(entries[1].path, "conflict.ui");
+		CHECK_EQ(entries[2].path, "link.h");
+		CHECK(entries[2].link);
+	}
+
+	void testVersions()
+	{
+		// extended flags from the version 3
+		string index = header(3, 2);
+		putEntry(index, "added.h", 0100644, 100, 10, 0, true);
+		putEntry(index, "b.h", 0100644);
+		vector<GitIndex::Entry> entries;
+		CHECK(GitIndex::parse(index, hashSize, entries));
+		CHECK_EQ(entries.size(), 2u);
+		CHECK(entries.size() == 2 && entries[0].path == "added.h" && entries[1].path == "b.h");
+
+		// not in the version 2
+		index = header(2, 1);
+		putEntry(index, "added.h", 0100644, 100, 10, 0, true);
+		entries.clear();
+		CHECK(!GitIndex::parse(index, hashSize, entries));
+
+		// paths of the version 4 strip the end of the previous one
+		index = header(4, 3);
+		putEntryV4(index, 0, "dir/a.h", 0100644);
+		putEntryV4(index, 3, "b.h", 0100644);
+		putEntryV4(index, 7, "other/c.ui", 0100644);
+		entries.clear();
+		CHECK(GitIndex::parse(index, hashSize, entries));
+		CHECK_EQ(entries.size(), 3u);
+		if (entries.size() == 3) {
+			CHECK_EQ(entries[0].path, "dir/a.h");
+			CHECK_EQ(entries[1].path, "dir/b.h");
+			CHECK_EQ(entries[2].path, "other/c.ui");
+		}
+
+		// more stripped than the previous path
+		index = header(4, 1);
+		putEntryV4(index, 2, "a.h", 0100644);
+		CHECK(!GitIndex::parse(index, hashSize, entries));
+
+		CHECK(!GitIndex::parse(header(1, 0), hashSize, entries));
+		CHECK(!GitIndex::parse(header(5, 0), hashSize, entries));
+		CHECK(!GitIndex::parse("DIRX" + header(2, 0).substr(4), hashSize, entries));
+
+		// truncated entries
+		index = header(2, 2);
+		putEntry(index, "a.h", 0100644);
+		CHECK(!GitIndex::parse(index, hashSize, entries));
+	}
+
+	void testExtensions()
+	{
+		string entries = header(2, 1);
+		putEntry(entries, "a.h", 0100644);
+
+		// the entries of a split index are elsewhere
+		string index = entries;
+		putExtension(index, "link", string(hashSize, 'l'));
+		index.append(hashSize, 'x');
+		vector<GitIndex::Entry> parsed;
+		CHECK(!GitIndex::parse(index, hashSize, parsed));
+
+		// other extensions are skipped
+		index = entries;
+		putExtension(index, "TREE", string(30, 't'));
+		putExtension(index, "UNTR", untrackedCache());
+		index.append(hashSize, 'x');
+		GitIndex::UntrackedCache cache;
+		parsed.clear();
+		CHECK(GitIndex::parse(index, hashSize, parsed, &cache));
+		CHECK_EQ(parsed.size(), 1u);
+
+		CHECK_EQ(cache.ident, string("Location /work/repo, system Linux") + '\0');
+		CHECK_EQ(cache.infoExclude.mtime, 50u);
+		CHECK_EQ(cache.infoExclude.size, 20u);
+		CHECK_EQ(cache.infoExcludeHash, string(hashSize, 'i'));
+		CHECK(cache.excludesFileHash.empty());
+		CHECK_EQ(cache.excludePerDir, ".gitignore");
+		CHECK_EQ(cache.dirs.size(), 2u);
+		if (cache.dirs.size() == 2) {
+			const GitIndex::UntrackedDir& root = cache.dirs[0];
+			CHECK(root.name.empty());
+			CHECK_EQ(root.dirCount, 1u);
+			CHECK_EQ(root.untracked.size(), 2u);
+			CHECK(root.untracked.size() == 2 && root.untracked[0] == "c.qrc" &&
+			      root.untracked[1] == "newdir/");
+			CHECK(root.valid && !root.checkOnly);
+			CHECK_EQ(root.stat.mtime, 60u);
+			CHECK_EQ(root.excludeHash, string(hashSize, 'g'));
+
+			const GitIndex::UntrackedDir& sub = cache.dirs[1];
+			CHECK_EQ(sub.name, "sub");
+			CHECK(sub.untracked.empty());
+			CHECK(sub.valid);
+			CHECK_EQ(sub.stat.mtime, 70u);
+			CHECK(sub.excludeHash.empty());
+		}
+
+		// an unreadable cache is dropped, the entries are still read
+		string truncated = untrackedCache();
+		truncated.erase(truncated.size() - hashSize - 1);
+		truncated.push_back('\0');
+		index = entries;
+		putExtension(index, "UNTR", truncated);
+		index.append(hashSize, 'x');
+		parsed.clear();
+		CHECK(GitIndex::parse(index, hashSize, parsed, &cache));
+		CHECK_EQ(parsed.size(), 1u);
+		CHECK(cache.dirs.empty() && cache.ident.empty());
+	}
+
+#ifndef _WIN32
+	// the index and the untracked cache written by git
+	bool testGit()
+	{
+		if (system("git --version > /dev/null 2>&1") != 0) {
+			return false;
+		}
+
+		string dir = test::makeDir("GitIndexTest");
+		string home = dir + "home";
+		string repo = dir + "repo/";
+		fu::mkDir(home);
+		fu::mkDir(repo);
+		fu::mkDir(repo + "sub");
+		fu::mkDir(repo + "build");
+		fu::mkDir(repo + "newdir");
+		test::writeFile(repo + ".gitignore", "build/\n");
+		test::writeFile(repo + "a.h", "a\n");
+		test::writeFile(repo + "sub/b.ui", "b\n");
+		test::writeFile(repo + "c.qrc", "c\n");
+		test::writeFile(repo + "build/x.ui", "x\n");
+		test::writeFile(repo + "newdir/d.ui", "d\n");
+
+		// no user config, the work tree and info/exclude older than the
+		// index, so that their cached stat data is not racy
+		setenv("HOME", home.c_str(), 1);
+		unsetenv("XDG_CONFIG_HOME");
+		setenv("GIT_CONFIG_NOSYSTEM", "1", 1);
+		time_t past = time(NULL) - 60;
+		char stamp[32];
+		strftime(stamp, sizeof(stamp), "%Y%m%d%H%M.%S", localtime(&past));
+		string cmd = "cd '" + repo + "' && git init -q . && git config core.untrackedCache true"
+		             " && find . -exec touch -h -t " + string(stamp) + " {} +"
+		             " && git add a.h sub/b.ui .gitignore"
+		             " && git status --porcelain > /dev/null && git status --porcelain > /dev/null";
+		CHECK_EQ(system(cmd.c_str()), 0);
+
+		string contents;
+		CHECK(FileCache::readSync(repo + ".git/index", contents));
+		vector<GitIndex::Entry> entries;
+		GitIndex::UntrackedCache cache;
+		CHECK(GitIndex::parse(contents, hashSize, entries, &cache));
+		CHECK_EQ(entries.size(), 3u);
+		if (entries.size() == 3) {
+			CHECK_EQ(entries[0].path, ".gitignore");
+			CHECK_EQ(entries[1].path, "a.h");
+			CHECK_EQ(entries[2].path, "sub/b.ui");
+			CHECK_EQ(entries[1].stat.size, 2u);
+		}
+		CHECK_EQ(cache.excludePerDir, ".gitignore");
+		CHECK(cache.dirs.size() > 0 && cache.dirs[0].valid);
+		if (cache.dirs.size() > 0) {
+			set<string> untracked (cache.dirs[0].untracked.begin(), cache.dirs[0].untracked.end());
+			CHECK(untracked.count("c.qrc") == 1 && untracked.count("newdir/") == 1);
+			CHECK_EQ(untracked.count("build/"), 0u);
+		}
+
+		// the ignored directory is not walked, nor the hidden files
+		GitIndex index;
+		CHECK(index.load(repo));
+		set<string> found;
+		auto collect = [&](const string& root, const string& filename, bool) {
+			found.insert((root + filename).substr(repo.size()));
+		};
+		index.walk(repo, collect);
+		set<string> expected;
+		expected.insert("a.h");
+		expected.insert("sub/b.ui");
+		expected.insert("c.qrc");
+		expected.insert("newdir/d.ui");
+		CHECK(found == expected);
+
+		// a modified .gitignore could unignore files: the directory is listed
+		cmd = "cd '" + repo + "' && echo '# none' > .gitignore";
+		CHECK_EQ(system(cmd.c_str()), 0);
+		CHECK(index.load(repo));
+		found.clear();
+		index.walk(repo, collect);
+		CHECK_EQ(found.count("build/x.ui"), 1u);
+
+		test::removeDir(dir.substr(0, dir.size() - 1));
+		return true;
+	}
+#endif
+
+}
+
+
+
+int main()
+{
+	testEntries();
+	testVersions();
+	testExtensions();
+#ifndef _WIN32
+	if (!testGit()) {
+		cerr << "git not found, the index it writes is not checked\n";
+	}
+#endif
+	return test::failures();
+}
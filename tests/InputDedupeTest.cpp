@@ -0,0 +1,84 @@
+/*
+	Copyright (c) 2013, Remi Thebault
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+		* Redistributions of source code must retain the above copyright
+		  notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above copyright
+		  notice, this list of conditions and the following disclaimer in the
+		  documentation and/or other materials provided with the distribution.
+		* Neither the name of the <organization> nor the
+		  names of its contributors may be used to endorse or promote products
+		  derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+	DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// An input listed several times is generated once.
+
+#include "Driver.h"
+#include "TestUtils.h"
+
+#include <string>
+#include <vector>
+
+
+using namespace std;
+
+
+
+int main()
+{
+#ifdef _WIN32
+	return test::skipped;
+#else
+	string dir = test::makeDir("InputDedupeTest");
+	fu::mkDir(dir + "src");
+	test::writeFile(dir + "src/a.gen", "a\n");
+	test::writeFile(dir + "src/b.gen", "b\n");
+
+	DriverConfig config;
+	config.qtBinPath = dir;
+	config.inD = dir + "src";
+	config.outD = dir + "out";
+	config.jobs = 2;
+	ToolConfig tool;
+	tool.name = "gen";
+	tool.exe = "/bin/cp";
+	tool.extensions.push_back(".gen");
+	tool.outPattern = "@BASE@.out";
+	tool.args = "@IN@ @OUT@";
+	config.tools.push_back(tool);
+
+	// the same file through the same and through another path
+	config.only.push_back(dir + "src/a.gen");
+	config.only.push_back(dir + "src/b.gen");
+	config.only.push_back(dir + "src/a.gen");
+	config.only.push_back(dir + "src/./a.gen");
+
+	Driver driver;
+	DriverResult result = driver.run(config);
+	CHECK(result.errors.empty());
+	CHECK_EQ(result.generated.size(), 2u);
+	size_t runs = 0;
+	for (size_t i=0; i<result.records.size(); ++i) {
+		if (result.records[i].tool == "gen") ++runs;
+	}
+	CHECK_EQ(runs, 2u);
+	CHECK(fu::isFile(dir + "out/a.out") && fu::isFile(dir + "out/b.out"));
+
+	test::removeDir(dir.substr(0, dir.size() - 1));
+	return test::failures();
+#endif
+}
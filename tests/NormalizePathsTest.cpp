@@ -0,0 +1,118 @@
+/*
+	Copyright (c) 2013, Remi Thebault
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+		* Redistributions of source code must retain the above copyright
+		  notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above copyright
+		  notice, this list of conditions and the following disclaimer in the
+		  documentation and/or other materials provided with the distribution.
+		* Neither the name of the <organization> nor the
+		  names of its contributors may be used to endorse or promote products
+		  derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+	DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Removal of the path base from the outputs (DriverConfig::pathBase).
+
+#include "Driver.h"
+#include "TestUtils.h"
+
+#include <string>
+#include <stdexcept>
+
+
+using namespace std;
+
+
+
+namespace {
+
+	string normalize(const string& contents)
+	{
+		return Driver::normalizePaths(contents, "/work/");
+	}
+
+	void testTokens()
+	{
+		// the include of the input by moc
+		CHECK_EQ(normalize("#include \"/work/src/a.h\"\n"), "#include \"src/a.h\"\n");
+		// the input named by the header comment of moc and uic
+		CHECK_EQ(normalize("** Meta object code from reading C++ file '/work/src/a.h'\n"),
+		         "** Meta object code from reading C++ file 'src/a.h'\n");
+		// the source file comment of a resource written by rcc
+		CHECK_EQ(normalize("  // /work/res/icon.png\n  0x0,0x0,\n"), "  // res/icon.png\n  0x0,0x0,\n");
+		CHECK_EQ(normalize("  // /work/res/last.png"), "  // res/last.png");
+
+		// each line on its own
+		CHECK_EQ(normalize("#include \"/work/a.h\"\n#include \"/work/b.h\"\n"),
+		         "#include \"a.h\"\n#include \"b.h\"\n");
+	}
+
+	void testKept()
+	{
+		// not a path the tools write
+		string text = "#include <QtCore/qobject.h>\n"
+		              "static const char path[] = \"/work/src\";\n";
+		CHECK_EQ(normalize(text), text);
+
+		// only at the start of the token
+		CHECK_EQ(normalize("#include \"src/work/a.h\"\n"), "#include \"src/work/a.h\"\n");
+		// another directory starting with the same name
+		CHECK_EQ(normalize("#include \"/workshop/a.h\"\n"), "#include \"/workshop/a.h\"\n");
+		// a token that is not closed on its line
+		CHECK_EQ(normalize("#include \"/work/a.h\n\"\n"), "#include \"/work/a.h\n\"\n");
+
+		// the base must end with a separator
+		CHECK_EQ(Driver::normalizePaths("#include \"/work/a.h\"\n", "/work"), "#include \"/work/a.h\"\n");
+		CHECK_EQ(Driver::normalizePaths("#include \"/work/a.h\"\n", ""), "#include \"/work/a.h\"\n");
+		CHECK_EQ(Driver::normalizePaths("#include \"C:\\work\\a.h\"\n", "C:\\work\\"), "#include \"a.h\"\n");
+	}
+
+	void testRootBase()
+	{
+		string dir = test::makeDir("NormalizePathsTest");
+		DriverConfig config;
+		config.qtBinPath = dir;
+		config.inD = dir;
+		config.outD = dir + "out";
+#ifdef _WIN32
+		config.pathBase = dir.substr(0, 3);
+#else
+		config.pathBase = "/";
+#endif
+		string error;
+		try {
+			Driver driver;
+			driver.run(config);
+		}
+		catch (const runtime_error& err) {
+			error = err.what();
+		}
+		CHECK_EQ(error, "path base directory cannot be a root directory");
+		test::removeDir(dir.substr(0, dir.size() - 1));
+	}
+
+}
+
+
+
+int main()
+{
+	testTokens();
+	testKept();
+	testRootBase();
+	return test::failures();
+}
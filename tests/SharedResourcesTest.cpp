@@ -0,0 +1,392 @@
+/*
+	Copyright (c) 2013, Remi Thebault
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+		* Redistributions of source code must retain the above copyright
+		  notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above copyright
+		  notice, this list of conditions and the following disclaimer in the
+		  documentation and/or other materials provided with the distribution.
+		* Neither the name of the <organization> nor the
+		  names of its contributors may be used to endorse or promote products
+		  derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+	DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Resources shared by several qrc files: the parsing of the qrc files, the
+// qrc files given to rcc, and the unit rcc generates for the shared
+// contents, read back as Qt looks the resources up. The unit is generated
+// with the rcc given as argument, if any.
+
+#include "SharedResources.h"
+#include "Driver.h"
+#include "TestUtils.h"
+
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+
+using namespace std;
+
+
+
+namespace {
+
+	// The resource tree of an rcc output: the data, name and struct arrays,
+	// looked up as QResource does.
+	class ResourceTree {
+	public:
+
+		enum Flags {
+			Compressed = 0x01,
+			Directory = 0x02,
+			CompressedZstd = 0x04
+		};
+
+		bool load(const string& path)
+		{
+			string contents;
+			if (!FileCache::readSync(path, contents)) return false;
+			size_t pos = contents.find("int version = ");
+			if (pos == string::npos) return false;
+			version_ = atoi(contents.c_str() + pos + 14);
+			return readArray(contents, "qt_resource_data", data_) &&
+			       readArray(contents, "qt_resource_name", names_) &&
+			       readArray(contents, "qt_resource_struct", tree_);
+		}
+
+		// false if there is no file at this path
+		bool find(const string& path, unsigned& flags, string& bytes) const
+		{
+			size_t node = 0;
+			size_t start = 1;
+			while (start <= path.size()) {
+				size_t end = min(path.find('/', start), path.size());
+				string name = path.substr(start, end - start);
+				start = end + 1;
+				if (!(number(tree_, offset(node) + 4, 2) & Directory)) return false;
+
+				// the children are sorted by the hash of their name
+				size_t count = number(tree_, offset(node) + 6, 4);
+				size_t first = number(tree_, offset(node) + 10, 4);
+				unsigned h = hash(name);
+				size_t lo = first, hi = first + count;
+				while (lo < hi) {
+					size_t mid = (lo + hi) / 2;
+					if (nameHash(mid) < h) lo = mid + 1;
+					else hi = mid;
+				}
+				while (lo < first + count && nameHash(lo) == h && nodeName(lo) != name) ++lo;
+				if (lo == first + count || nodeName(lo) != name) return false;
+				node = lo;
+			}
+
+			flags = number(tree_, offset(node) + 4, 2);
+			if (flags & Directory) return false;
+			size_t dataOffset = number(tree_, offset(node) + 10, 4);
+			size_t size = number(data_, dataOffset, 4);
+			bytes = data_.substr(dataOffset + 4, size);
+			return true;
+		}
+
+	private:
+
+		static bool readArray(const string& contents, const string& name, string& bytes)
+		{
+			size_t pos = contents.find("static const unsigned char " + name + "[]");
+			if (pos == string::npos) return false;
+			size_t end = contents.find("};", pos);
+			pos = contents.find('{', pos);
+			bytes.clear();
+			while (pos < end) {
+				if (contents.compare(pos, 2, "//") == 0) {
+					pos = contents.find('\n', pos);
+					continue;
+				}
+				if (contents.compare(pos, 2, "0x") == 0) {
+					bytes.push_back(char(strtoul(contents.c_str() + pos, NULL, 16)));
+					pos += 2;
+					continue;
+				}
+				++pos;
+			}
+			return true;
+		}
+
+		static size_t number(const string& bytes, size_t pos, int size)
+		{
+			size_t res = 0;
+			for (int i=0; i<size && pos+i < bytes.size(); ++i) {
+				res = (res << 8) | (unsigned char)bytes[pos+i];
+			}
+			return res;
+		}
+
+		// the names here are ASCII
+		static unsigned hash(const string& name)
+		{
+			unsigned h = 0;
+			for (size_t i=0; i<name.size(); ++i) {
+				h = (h << 4) + (unsigned char)name[i];
+				h ^= (h & 0xf0000000) >> 23;
+				h &= 0x0fffffff;
+			}
+			return h;
+		}
+
+		// struct entries of 14 bytes, and the modification time from the version 2
+		size_t offset(size_t node) const
+		{
+			return node * (version_ >= 2 ? 22 : 14);
+		}
+
+		unsigned nameHash(size_t node) const
+		{
+			return unsigned(number(names_, number(tree_, offset(node), 4) + 2, 4));
+		}
+
+		string nodeName(size_t node) const
+		{
+			size_t pos = number(tree_, offset(node), 4);
+			size_t length = number(names_, pos, 2);
+			string name;
+			for (size_t i=0; i<length; ++i) {
+				name.push_back(char(number(names_, pos + 6 + 2*i, 2)));
+			}
+			return name;
+		}
+
+		int version_;
+		string data_;
+		string names_;
+		string tree_;
+	};
+
+	void testParseQrc(const string& dir)
+	{
+		fu::mkDir(dir + "icons");
+		test::writeFile(dir + "icons/b.png", "b");
+		test::writeFile(dir + "icons/a.png", "a");
+		test::writeFile(dir + "test.qrc",
+			"<!DOCTYPE RCC><RCC version=\"1.0\">\n"
+			"<!-- <qresource prefix=\"/commented\"><file>x</file></qresource> -->\n"
+			"<qresource>\n"
+			"\t<file alias=\"./img/../logo.png\">icons/a.png</file>\n"
+			"\t<file compress=\"9\" threshold='0'>icons/b.png</file>\n"
+			"</qresource>\n"
+			"<qresource prefix=\"app\" lang=\"fr\">\n"
+			"\t<file>  icons/a.png  </file>\n"
+			"</qresource>\n"
+			"<qresource prefix=\"/dir/\">\n"
+			"\t<file alias=\"all\">icons</file>\n"
+			"\t<file>R&amp;D.txt</file>\n"
+			"</qresource>\n"
+			"</RCC>\n");
+
+		vector<SharedResources::Resource> res;
+		CHECK(SharedResources::parseQrc(dir + "test.qrc", res));
+		CHECK_EQ(res.size(), 6u);
+		if (res.size() != 6) return;
+
+		CHECK_EQ(res[0].prefix, "/");
+		CHECK_EQ(res[0].alias, "logo.png");
+		CHECK_EQ(res[0].file, dir + "icons/a.png");
+		CHECK(res[0].attributes.empty());
+
+		CHECK_EQ(res[1].alias, "icons/b.png");
+		CHECK_EQ(res[1].attributes, " compress=\"9\" threshold=\"0\"");
+
+		CHECK_EQ(res[2].prefix, "/app/");
+		CHECK_EQ(res[2].lang, "fr");
+		CHECK_EQ(res[2].alias, "icons/a.png");
+
+		// a directory gives its files, sorted, under its alias
+		CHECK_EQ(res[3].prefix, "/dir/");
+		CHECK(res[3].lang.empty());
+		CHECK_EQ(res[3].alias, "all/a.png");
+		CHECK_EQ(res[4].alias, "all/b.png");
+		CHECK_EQ(res[4].file, dir + "icons/b.png");
+
+		CHECK_EQ(res[5].alias, "R&D.txt");
+
+		CHECK(!SharedResources::parseQrc(dir + "missing.qrc", res));
+	}
+
+	// two modules embedding the same icon and text, each with its own file,
+	// and b giving a path of a too
+	void writeModules(const string& src)
+	{
+		fu::mkDir(src + "a");
+		fu::mkDir(src + "b");
+		string icon;
+		// not compressible
+		unsigned seed = 1;
+		for (int i=0; i<3000; ++i) {
+			seed = seed * 1103515245 + 12345;
+			icon.push_back(char(seed >> 16));
+		}
+		string text;
+		for (int i=0; i<500; ++i) text += "shared text, compressed by rcc\n";
+		test::writeFile(src + "a/icon.png", icon);
+		test::writeFile(src + "b/icon.png", icon);
+		test::writeFile(src + "a/text.txt", text);
+		test::writeFile(src + "b/copy.txt", text);
+		test::writeFile(src + "b/text.txt", text);
+		test::writeFile(src + "a/own.txt", "a");
+		test::writeFile(src + "b/own.txt", "b");
+		test::writeFile(src + "a/a.qrc",
+			"<RCC>\n<qresource prefix=\"/a\">\n"
+			"<file>icon.png</file>\n<file>text.txt</file>\n<file>own.txt</file>\n"
+			"</qresource>\n</RCC>\n");
+		test::writeFile(src + "b/b.qrc",
+			"<RCC>\n<qresource prefix=\"/b\">\n"
+			"<file alias=\"img/icon.png\">icon.png</file>\n<file>copy.txt</file>\n<file>own.txt</file>\n"
+			"</qresource>\n<qresource prefix=\"/a\">\n"
+			"<file>text.txt</file>\n"
+			"</qresource>\n</RCC>\n");
+	}
+
+	void testQrcFiles(const string& dir)
+	{
+		string src = dir + "src/";
+		fu::mkDir(src);
+		writeModules(src);
+
+		vector<string> qrcFiles;
+		qrcFiles.push_back(src + "b/b.qrc");
+		qrcFiles.push_back(src + "a/a.qrc");
+		SharedResources shared;
+		shared.update(qrcFiles, NULL);
+		CHECK(shared.shares(src + "a/a.qrc"));
+		CHECK(shared.shares(src + "b/b.qrc"));
+
+		// the qrc files given to rcc keep their own files only
+		test::writeFile(dir + "a.qrc", shared.qrcContents(src + "a/a.qrc", dir));
+		vector<SharedResources::Resource> res;
+		CHECK(SharedResources::parseQrc(dir + "a.qrc", res));
+		CHECK(res.size() == 1 && res[0].prefix == "/a/" && res[0].alias == "own.txt" &&
+		      res[0].file == src + "a/own.txt");
+
+		// the unit has every shared path once, the first qrc file giving it wins
+		unsigned long long signature = shared.signature("shared", "", "");
+		CHECK(signature != 0);
+		test::writeFile(dir + "unit.qrc", shared.unitQrcContents(dir, signature));
+		CHECK_EQ(SharedResources::unitSignature(dir + "unit.qrc"), signature);
+		res.clear();
+		CHECK(SharedResources::parseQrc(dir + "unit.qrc", res));
+		CHECK_EQ(res.size(), 4u);
+		if (res.size() == 4) {
+			CHECK(res[0].prefix == "/a/" && res[0].alias == "icon.png" && res[0].file == src + "a/icon.png");
+			CHECK(res[1].prefix == "/a/" && res[1].alias == "text.txt" && res[1].file == src + "a/text.txt");
+			CHECK(res[2].prefix == "/b/" && res[2].alias == "img/icon.png" && res[2].file == src + "b/icon.png");
+			CHECK(res[3].prefix == "/b/" && res[3].alias == "copy.txt" && res[3].file == src + "b/copy.txt");
+		}
+
+		// the signature follows the name, the rcc options and the contents
+		CHECK(shared.signature("other", "", "") != signature);
+		CHECK(shared.signature("shared", "--no-compress", "") != signature);
+		test::writeFile(src + "b/icon.png", "changed");
+		shared.update(qrcFiles, NULL);
+		CHECK(shared.signature("shared", "", "") != signature);
+	}
+
+	// the unit generated by rcc registers every shared path with its bytes
+	void testUnit(const string& dir, const string& rcc, const string& rccOpts, bool compressed)
+	{
+		string src = dir + "src/";
+		fu::mkDir(src);
+		writeModules(src);
+
+		DriverConfig config;
+		config.qtBinPath = fu::parentDir(rcc);
+		config.inD = src;
+		config.outD = dir + "out";
+		config.rccShared = "shared";
+		config.rccOpts = rccOpts;
+		Driver driver;
+		DriverResult result = driver.run(config);
+		CHECK(result.errors.empty());
+		for (size_t i=0; i<result.errors.size(); ++i) cerr << result.errors[i] << "\n";
+
+		ResourceTree unit;
+		CHECK(unit.load(dir + "out/rc_shared.cc"));
+		string icon, text;
+		FileCache::readSync(src + "a/icon.png", icon);
+		FileCache::readSync(src + "a/text.txt", text);
+		const char *paths[][2] = {
+			{ "/a/icon.png", "icon" }, { "/a/text.txt", "text" },
+			{ "/b/img/icon.png", "icon" }, { "/b/copy.txt", "text" }
+		};
+		for (size_t i=0; i<4; ++i) {
+			unsigned flags = 0;
+			string bytes;
+			CHECK(unit.find(paths[i][0], flags, bytes));
+			bool isText = string(paths[i][1]) == "text";
+			if (isText && compressed) {
+				CHECK(flags & (ResourceTree::Compressed | ResourceTree::CompressedZstd));
+				CHECK(bytes.size() < text.size());
+			}
+			else {
+				CHECK_EQ(flags, 0u);
+				CHECK(bytes == (isText ? text : icon));
+			}
+		}
+		unsigned flags;
+		string bytes;
+		CHECK(!unit.find("/a/own.txt", flags, bytes));
+		CHECK(!unit.find("/b/icon.png", flags, bytes));
+		CHECK(!unit.find("/a", flags, bytes));
+
+		// the qrc files of the modules keep their own files
+		ResourceTree module;
+		CHECK(module.load(dir + "out/rc_a.cc"));
+		CHECK(module.find("/a/own.txt", flags, bytes) && bytes == "a");
+		CHECK(!module.find("/a/icon.png", flags, bytes));
+
+		// generated again only when something changes
+		result = driver.run(config);
+		CHECK_EQ(result.generated.size() + result.updated.size(), 0u);
+		config.rccOpts += " --threshold 100";
+		result = driver.run(config);
+		CHECK_EQ(result.updated.size(), 1u);
+		CHECK(result.updated.size() == 1 && result.updated[0] == dir + "out/rc_shared.cc");
+	}
+
+}
+
+
+
+int main(int argc, char *argv[])
+{
+	string dir = test::makeDir("SharedResourcesTest");
+	testParseQrc(dir);
+	testQrcFiles(dir);
+
+	if (argc > 1) {
+		test::removeDir(dir.substr(0, dir.size() - 1));
+		dir = test::makeDir("SharedResourcesTest");
+		testUnit(dir, argv[1], "--no-compress", false);
+		test::removeDir(dir.substr(0, dir.size() - 1));
+		dir = test::makeDir("SharedResourcesTest");
+		testUnit(dir, argv[1], "--compress 9 --threshold 0", true);
+	}
+	else {
+		cerr << "no rcc given, the generated unit is not checked\n";
+	}
+
+	test::removeDir(dir.substr(0, dir.size() - 1));
+	return test::failures();
+}
@@ -0,0 +1,94 @@
+/*
+	Copyright (c) 2013, Remi Thebault
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+		* Redistributions of source code must retain the above copyright
+		  notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above copyright
+		  notice, this list of conditions and the following disclaimer in the
+		  documentation and/or other materials provided with the distribution.
+		* Neither the name of the <organization> nor the
+		  names of its contributors may be used to endorse or promote products
+		  derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+	DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "FileUtils.h"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+
+// Checks of the unit tests: a failed check is reported, and the test exits
+// with the number of failed checks.
+#define CHECK(cond) test::check((cond), #cond, __FILE__, __LINE__)
+#define CHECK_EQ(a, b) test::check((a) == (b), #a " == " #b, __FILE__, __LINE__)
+
+namespace test {
+
+	// exit status of a test that cannot run here (see SKIP_RETURN_CODE)
+	const int skipped = 77;
+
+	inline int& failures()
+	{
+		static int count = 0;
+		return count;
+	}
+
+	inline void check(bool ok, const char *expr, const char *file, int line)
+	{
+		if (!ok) {
+			std::cerr << file << ":" << line << ": check failed: " << expr << "\n";
+			++failures();
+		}
+	}
+
+	inline bool writeFile(const std::string& path, const std::string& contents)
+	{
+		std::ofstream out (path, std::ios::binary | std::ios::trunc);
+		out << contents;
+		return bool(out);
+	}
+
+	// with its hidden files, that the walks of FileUtils skip
+	inline void removeDir(const std::string& path)
+	{
+		if (!fu::exists(path)) return;
+#ifdef _WIN32
+		std::string cmd = "rmdir /s /q \"" + path + "\"";
+#else
+		std::string cmd = "rm -rf '" + path + "'";
+#endif
+		int status = std::system(cmd.c_str());
+		(void)status;
+	}
+
+	// an empty directory named after the test in the current directory,
+	// with a trailing separator
+	inline std::string makeDir(const std::string& name)
+	{
+		std::string dir = name + ".tmp";
+		removeDir(dir);
+		fu::mkDir(dir);
+		dir.push_back(fu::pathSep);
+		return dir;
+	}
+
+}